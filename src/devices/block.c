@@ -3,7 +3,12 @@
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 
 /* A block device. */
 struct block
@@ -17,10 +22,25 @@ struct block
     const struct block_operations *ops;  /* Driver operations. */
     void *aux;                          /* Extra data owned by driver. */
 
-    unsigned long long read_cnt;        /* Number of sectors read. */
-    unsigned long long write_cnt;       /* Number of sectors written. */
+    struct blkstat stats;               /* Statistics. */
+    unsigned outstanding;               /* Requests issued but not done. */
+    int bus;                            /* Bus number, or -1 if unknown. */
+
+    /* Request queue. */
+    struct lock queue_lock;             /* Protects the members below. */
+    struct list queue;                  /* Pending requests, by sector. */
+    struct condition queue_ready;       /* Signaled when work may be ready. */
+    int depth;                          /* Max requests in driver at once. */
+    int in_flight;                      /* Requests now in the driver. */
+    int worker_cnt;                     /* Number of worker threads. */
+    int idle_cnt;                       /* Number of them waiting for work. */
+    block_sector_t head;                /* Sector after last one transferred. */
   };
 
+/* Most sectors to combine into one driver call by merging
+   adjacent requests. */
+#define MAX_MERGE_SECTORS 128
+
 /* List of all block devices. */
 static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 
@@ -28,6 +48,12 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static void transfer (struct block *, struct block_request *);
+static void bounce_transfer (struct block *, bool write, block_sector_t,
+                             size_t cnt, uint8_t *buffer);
+static void enqueue (struct block *, struct block_request *);
+static void request_start (struct block *, struct block_request *);
+static void request_done (struct block *, struct block_request *);
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -113,6 +139,99 @@ check_sector (struct block *block, block_sector_t sector)
     }
 }
 
+/* Carries out the CNT-sector transfer described by WRITE,
+   SECTOR, and BUFFER synchronously.  If nothing is queued for
+   BLOCK and its driver has room for another request, the calling
+   thread calls the driver itself; otherwise the request joins
+   the queue like any other and we wait for it.
+
+   BUFFER may be in user memory, but queued requests are carried
+   out by a worker thread, which runs in whatever address space
+   it happens to have borrowed, so a user buffer is only ever
+   touched from the calling thread. */
+static void
+sync_transfer (struct block *block, bool write, block_sector_t sector,
+               size_t cnt, void *buffer)
+{
+  struct block_request r;
+
+  r.write = write;
+  r.sector = sector;
+  r.cnt = cnt;
+  r.buffer = buffer;
+  r.callback = NULL;
+
+  lock_acquire (&block->queue_lock);
+  if (block->in_flight < block->depth && list_empty (&block->queue))
+    {
+      block->in_flight++;
+      lock_release (&block->queue_lock);
+
+      request_start (block, &r);
+
+      transfer (block, &r);
+
+      lock_acquire (&block->queue_lock);
+      block->in_flight--;
+      block->head = sector + cnt;
+      if (!list_empty (&block->queue))
+        cond_signal (&block->queue_ready, &block->queue_lock);
+      lock_release (&block->queue_lock);
+      request_done (block, &r);
+    }
+  else
+    {
+      lock_release (&block->queue_lock);
+      if (!is_kernel_vaddr (buffer))
+        bounce_transfer (block, write, sector, cnt, buffer);
+      else
+        {
+          sema_init (&r.done, 0);
+          request_start (block, &r);
+          enqueue (block, &r);
+          block_wait (&r);
+        }
+    }
+}
+
+/* Carries out the CNT-sector transfer described by WRITE,
+   SECTOR, and BUFFER, which is in user memory, through BLOCK's
+   queue, copying the data through a kernel page a page at a
+   time.  Falls back to a single sector at a time if no page is
+   available. */
+static void
+bounce_transfer (struct block *block, bool write, block_sector_t sector,
+                 size_t cnt, uint8_t *buffer)
+{
+  uint8_t sector_bounce[BLOCK_SECTOR_SIZE];
+  uint8_t *page = palloc_get_page (0);
+  uint8_t *bounce = page != NULL ? page : sector_bounce;
+  size_t chunk = page != NULL ? PGSIZE / BLOCK_SECTOR_SIZE : 1;
+  size_t done;
+
+  for (done = 0; done < cnt; done += chunk)
+    {
+      struct block_request r;
+      size_t n = cnt - done < chunk ? cnt - done : chunk;
+      uint8_t *user = buffer + done * BLOCK_SECTOR_SIZE;
+
+      r.write = write;
+      r.sector = sector + done;
+      r.cnt = n;
+      r.buffer = bounce;
+      r.callback = NULL;
+      if (write)
+        memcpy (bounce, user, n * BLOCK_SECTOR_SIZE);
+      sema_init (&r.done, 0);
+      request_start (block, &r);
+      enqueue (block, &r);
+      block_wait (&r);
+      if (!write)
+        memcpy (user, bounce, n * BLOCK_SECTOR_SIZE);
+    }
+  palloc_free_page (page);
+}
+
 /* Reads sector SECTOR from BLOCK into BUFFER, which must
    have room for BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to block devices, so external
@@ -120,9 +239,7 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  block_read_multiple (block, sector, 1, buffer);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -133,10 +250,314 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
+  block_write_multiple (block, sector, 1, buffer);
+}
+
+/* Verifies that the CNT sectors starting at SECTOR all lie
+   within BLOCK.  Panics if not. */
+static void
+check_sectors (struct block *block, block_sector_t sector, size_t cnt)
+{
+  ASSERT (cnt > 0);
   check_sector (block, sector);
+  check_sector (block, sector + cnt - 1);
+}
+
+/* Reads CNT consecutive sectors starting at SECTOR from BLOCK
+   into BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes.  Drivers that support it do this with fewer commands
+   and interrupts than CNT calls to block_read().
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multiple (struct block *block, block_sector_t sector, size_t cnt,
+                     void *buffer)
+{
+  check_sectors (block, sector, cnt);
+  sync_transfer (block, false, sector, cnt, buffer);
+}
+
+/* Writes CNT consecutive sectors starting at SECTOR to BLOCK
+   from BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the block device has acknowledged receiving the
+   data.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multiple (struct block *block, block_sector_t sector,
+                      size_t cnt, const void *buffer)
+{
+  check_sectors (block, sector, cnt);
+  ASSERT (block->type != BLOCK_FOREIGN);
+  sync_transfer (block, true, sector, cnt, (void *) buffer);
+}
+
+/* Makes every write to BLOCK that has completed durable, by
+   flushing the device's write cache, if it has one.  Writes
+   still in BLOCK's request queue are not covered. */
+void
+block_flush (struct block *block)
+{
   ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  if (block->ops->flush != NULL)
+    block->ops->flush (block->aux);
+}
+
+/* Asynchronous requests. */
+
+static void worker (void *block_);
+
+/* Orders block requests by sector. */
+static bool
+request_less (const struct list_elem *a_, const struct list_elem *b_,
+              void *aux UNUSED)
+{
+  const struct block_request *a = list_entry (a_, struct block_request, elem);
+  const struct block_request *b = list_entry (b_, struct block_request, elem);
+  return a->sector < b->sector;
+}
+
+/* Queues request R for BLOCK and returns without waiting for it
+   to complete.  See the comment on struct block_request for how
+   completion is reported.  R's buffer must be in kernel memory,
+   because the request is carried out by a worker thread. */
+void
+block_submit (struct block *block, struct block_request *r)
+{
+  check_sectors (block, r->sector, r->cnt);
+  ASSERT (is_kernel_vaddr (r->buffer));
+  ASSERT (!r->write || block->type != BLOCK_FOREIGN);
+  sema_init (&r->done, 0);
+  request_start (block, r);
+  enqueue (block, r);
+}
+
+/* Adds R to BLOCK's queue, starting a worker thread to serve it
+   if needed. */
+static void
+enqueue (struct block *block, struct block_request *r)
+{
+  lock_acquire (&block->queue_lock);
+  if (block->idle_cnt == 0 && block->worker_cnt < block->depth)
+    {
+      char name[sizeof block->name + 16];
+      snprintf (name, sizeof name, "%s-io%d", block->name, block->worker_cnt);
+      if (thread_create (name, PRI_DEFAULT, worker, block) == TID_ERROR)
+        PANIC ("%s: cannot start I/O thread", block->name);
+      block->worker_cnt++;
+    }
+  list_insert_ordered (&block->queue, &r->elem, request_less, NULL);
+  cond_signal (&block->queue_ready, &block->queue_lock);
+  lock_release (&block->queue_lock);
+}
+
+/* Waits for request R, which must have been submitted without a
+   callback, to complete. */
+void
+block_wait (struct block_request *r)
+{
+  ASSERT (r->callback == NULL);
+  sema_down (&r->done);
+}
+
+/* Removes the next batch of requests to carry out from BLOCK's
+   queue and adds them, in sector order, to BATCH.  The caller
+   must hold the queue lock and the queue must not be empty.
+
+   Requests are chosen in C-LOOK order: the first one at or past
+   the sector where the last transfer ended, or else the lowest
+   one, so that the disk sweeps across its surface in a single
+   direction.  Following requests in the same direction whose
+   sectors and buffers both continue where the previous one left
+   off are merged into the same batch, so that the driver can
+   transfer them all in one call. */
+static void
+next_batch (struct block *block, struct list *batch)
+{
+  struct list_elem *e;
+  struct block_request *first, *last;
+  size_t cnt;
+
+  ASSERT (!list_empty (&block->queue));
+
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    if (list_entry (e, struct block_request, elem)->sector >= block->head)
+      break;
+  if (e == list_end (&block->queue))
+    e = list_begin (&block->queue);
+
+  first = last = list_entry (e, struct block_request, elem);
+  cnt = first->cnt;
+  for (;;)
+    {
+      struct list_elem *next = list_next (e);
+      struct block_request *r;
+
+      list_remove (e);
+      list_push_back (batch, e);
+      if (next == list_end (&block->queue))
+        break;
+
+      r = list_entry (next, struct block_request, elem);
+      if (r->write != first->write
+          || r->sector != last->sector + last->cnt
+          || (uint8_t *) r->buffer
+             != (uint8_t *) last->buffer + last->cnt * BLOCK_SECTOR_SIZE
+          || cnt + r->cnt > MAX_MERGE_SECTORS)
+        break;
+
+      last = r;
+      cnt += r->cnt;
+      e = next;
+    }
+}
+
+/* Records the completion of R on BLOCK and calls R's
+   completion callback or wakes up its waiter. */
+static void
+complete (struct block *block, struct block_request *r)
+{
+  request_done (block, r);
+  if (r->callback != NULL)
+    r->callback (r);
+  else
+    sema_up (&r->done);
+}
+
+/* Carries out the queued requests for BLOCK, one batch at a
+   time, whenever fewer than BLOCK's queue depth are already in
+   the driver.  Runs as a kernel thread.  Up to one worker per
+   unit of queue depth is started, so that drivers that can have
+   several requests outstanding get them. */
+static void
+worker (void *block_)
+{
+  struct block *block = block_;
+
+  lock_acquire (&block->queue_lock);
+  for (;;)
+    {
+      struct list batch;
+      struct block_request *first, *last, merged;
+
+      while (block->in_flight >= block->depth || list_empty (&block->queue))
+        {
+          block->idle_cnt++;
+          cond_wait (&block->queue_ready, &block->queue_lock);
+          block->idle_cnt--;
+        }
+
+      list_init (&batch);
+      next_batch (block, &batch);
+      block->in_flight++;
+      lock_release (&block->queue_lock);
+
+      /* Transfer the whole batch at once. */
+      first = list_entry (list_front (&batch), struct block_request, elem);
+      last = list_entry (list_back (&batch), struct block_request, elem);
+      merged = *first;
+      merged.cnt = last->sector + last->cnt - first->sector;
+      transfer (block, &merged);
+
+      /* Report completion outside the lock, since callbacks may
+         submit more requests. */
+      while (!list_empty (&batch))
+        complete (block, list_entry (list_pop_front (&batch),
+                                     struct block_request, elem));
+
+      lock_acquire (&block->queue_lock);
+      block->in_flight--;
+      block->head = merged.sector + merged.cnt;
+      if (!list_empty (&block->queue))
+        cond_signal (&block->queue_ready, &block->queue_lock);
+    }
+}
+
+/* Has BLOCK's driver carry out request R. */
+static void
+transfer (struct block *block, struct block_request *r)
+{
+  const struct block_operations *ops = block->ops;
+  uint8_t *buffer = r->buffer;
+  size_t i;
+
+  if (r->write)
+    {
+      if (ops->write_multiple != NULL)
+        ops->write_multiple (block->aux, r->sector, r->cnt, buffer);
+      else
+        for (i = 0; i < r->cnt; i++)
+          ops->write (block->aux, r->sector + i,
+                      buffer + i * BLOCK_SECTOR_SIZE);
+    }
+  else
+    {
+      if (ops->read_multiple != NULL)
+        ops->read_multiple (block->aux, r->sector, r->cnt, buffer);
+      else
+        for (i = 0; i < r->cnt; i++)
+          ops->read (block->aux, r->sector + i,
+                     buffer + i * BLOCK_SECTOR_SIZE);
+    }
+}
+
+/* Statistics. */
+
+/* Notes that request R has been issued to BLOCK. */
+static void
+request_start (struct block *block, struct block_request *r)
+{
+  enum intr_level old_level;
+
+  r->start = rdtsc ();
+
+  old_level = intr_disable ();
+  if (++block->outstanding > block->stats.max_outstanding)
+    block->stats.max_outstanding = block->outstanding;
+  intr_set_level (old_level);
+}
+
+/* Notes that request R on BLOCK has completed, and accounts for
+   its latency. */
+static void
+request_done (struct block *block, struct block_request *r)
+{
+  uint64_t cycles = rdtsc () - r->start;
+  struct blkstat *s = &block->stats;
+  enum intr_level old_level;
+  int bucket;
+
+  for (bucket = 0; bucket < BLKSTAT_BUCKETS - 1; bucket++)
+    if (cycles >> (bucket + 1) == 0)
+      break;
+
+  old_level = intr_disable ();
+  block->outstanding--;
+  if (r->write)
+    {
+      s->write_cnt++;
+      s->write_bytes += r->cnt * BLOCK_SECTOR_SIZE;
+    }
+  else
+    {
+      s->read_cnt++;
+      s->read_bytes += r->cnt * BLOCK_SECTOR_SIZE;
+    }
+  s->total_cycles += cycles;
+  if (cycles > s->max_cycles)
+    s->max_cycles = cycles;
+  s->histogram[bucket]++;
+  intr_set_level (old_level);
+}
+
+/* Copies BLOCK's statistics into *STATS. */
+void
+block_get_stats (struct block *block, struct blkstat *stats)
+{
+  enum intr_level old_level = intr_disable ();
+  *stats = block->stats;
+  intr_set_level (old_level);
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -171,9 +592,28 @@ block_print_stats (void)
       struct block *block = block_by_role[i];
       if (block != NULL)
         {
+          struct blkstat s;
+          unsigned long long requests;
+          int bucket;
+
+          block_get_stats (block, &s);
           printf ("%s (%s): %llu reads, %llu writes\n",
                   block->name, block_type_name (block->type),
-                  block->read_cnt, block->write_cnt);
+                  s.read_bytes / BLOCK_SECTOR_SIZE,
+                  s.write_bytes / BLOCK_SECTOR_SIZE);
+
+          requests = s.read_cnt + s.write_cnt;
+          if (requests == 0)
+            continue;
+          printf ("  %llu requests, latency avg %llu max %llu cycles, "
+                  "max %u outstanding\n",
+                  requests, s.total_cycles / requests, s.max_cycles,
+                  s.max_outstanding);
+          printf ("  latency histogram (log2 cycles: requests):");
+          for (bucket = 0; bucket < BLKSTAT_BUCKETS; bucket++)
+            if (s.histogram[bucket] != 0)
+              printf (" %d:%llu", bucket, s.histogram[bucket]);
+          printf ("\n");
         }
     }
 }
@@ -198,8 +638,17 @@ block_register (const char *name, enum block_type type,
   block->size = size;
   block->ops = ops;
   block->aux = aux;
-  block->read_cnt = 0;
-  block->write_cnt = 0;
+  memset (&block->stats, 0, sizeof block->stats);
+  block->outstanding = 0;
+  block->bus = -1;
+  lock_init (&block->queue_lock);
+  list_init (&block->queue);
+  cond_init (&block->queue_ready);
+  block->depth = 1;
+  block->in_flight = 0;
+  block->worker_cnt = 0;
+  block->idle_cnt = 0;
+  block->head = 0;
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -211,6 +660,42 @@ block_register (const char *name, enum block_type type,
   return block;
 }
 
+/* Records that BLOCK is attached to bus number BUS.  Drivers
+   whose devices share a bus, such as the two disks on an IDE
+   channel, should give them the same number. */
+void
+block_set_bus (struct block *block, int bus)
+{
+  block->bus = bus;
+}
+
+/* Returns the number of the bus that BLOCK is attached to, or -1
+   if unknown or not shared with other devices. */
+int
+block_bus (struct block *block)
+{
+  return block->bus;
+}
+
+/* Allows up to DEPTH requests to be in BLOCK's driver at once.
+   The default is 1.  Drivers whose hardware can have several
+   requests outstanding, and whose operations may be called from
+   several threads at once, may raise it. */
+void
+block_set_queue_depth (struct block *block, int depth)
+{
+  ASSERT (depth > 0);
+  block->depth = depth;
+}
+
+/* Returns the number of requests that may be in BLOCK's driver
+   at once. */
+int
+block_queue_depth (struct block *block)
+{
+  return block->depth;
+}
+
 /* Returns the block device corresponding to LIST_ELEM, or a null
    pointer if LIST_ELEM is the list end of all_blocks. */
 static struct block *
@@ -1,8 +1,12 @@
 #ifndef DEVICES_BLOCK_H
 #define DEVICES_BLOCK_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
+#include <blkstat.h>
+#include <list.h>
+#include "threads/synch.h"
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -53,11 +57,44 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, size_t cnt,
+                          void *);
+void block_write_multiple (struct block *, block_sector_t, size_t cnt,
+                           const void *);
+void block_flush (struct block *);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
+/* Asynchronous requests.
+
+   The submitter fills in the first group of members and passes
+   the request to block_submit(), which returns at once.  The
+   request is queued with others for the same device and carried
+   out in elevator order.  When it is done, CALLBACK is called
+   with the request, from a kernel thread owned by the block
+   layer; if CALLBACK is null, the submitter must instead call
+   block_wait().  The request must stay allocated until then. */
+struct block_request
+  {
+    bool write;                 /* True to write, false to read. */
+    block_sector_t sector;      /* First sector. */
+    size_t cnt;                 /* Number of sectors. */
+    void *buffer;               /* CNT * BLOCK_SECTOR_SIZE bytes. */
+    void (*callback) (struct block_request *); /* Completion, or null. */
+    void *aux;                  /* For use by CALLBACK. */
+
+    /* Owned by block.c. */
+    struct list_elem elem;      /* Element in device queue. */
+    struct semaphore done;      /* Up'd on completion if no CALLBACK. */
+    uint64_t start;             /* Timestamp when issued. */
+  };
+
+void block_submit (struct block *, struct block_request *);
+void block_wait (struct block_request *);
+
 /* Statistics. */
 void block_print_stats (void);
+void block_get_stats (struct block *, struct blkstat *);
 
 /* Lower-level interface to block device drivers. */
 
@@ -65,10 +102,32 @@ struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Optional.  Transfer CNT consecutive sectors at once.  If
+       null, the block layer calls read or write once per
+       sector. */
+    void (*read_multiple) (void *aux, block_sector_t, size_t cnt,
+                           void *buffer);
+    void (*write_multiple) (void *aux, block_sector_t, size_t cnt,
+                            const void *buffer);
+
+    /* Optional.  Makes completed writes durable, by writing out
+       any volatile write cache.  If null, the device has no such
+       cache. */
+    void (*flush) (void *aux);
   };
 
 struct block *block_register (const char *name, enum block_type,
                               const char *extra_info, block_sector_t size,
                               const struct block_operations *, void *aux);
 
+/* Buses.  Block devices on different buses (e.g. IDE channels)
+   can transfer data at the same time. */
+void block_set_bus (struct block *, int bus);
+int block_bus (struct block *);
+
+/* Number of requests that the driver can work on at once. */
+void block_set_queue_depth (struct block *, int depth);
+int block_queue_depth (struct block *);
+
 #endif /* devices/block.h */
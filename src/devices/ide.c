@@ -3,15 +3,24 @@
 #include <debug.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/block.h"
 #include "devices/partition.h"
+#include "devices/pci.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].
+
+   If the controller is a PCI bus master IDE controller, such as
+   the Intel PIIX family that QEMU emulates, and the disk supports
+   DMA, sectors are transferred by DMA instead of PIO, so that the
+   CPU is free while the disk moves the data.  See [BMIDE]. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -30,10 +39,26 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206)  /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)       /* Alt Status (r/o). */
 
+/* Bus master IDE port addresses, relative to the channel's bus
+   master base. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table. */
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
+#define STA_DF 0x20             /* Device Fault. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
+
+/* Bus Master Command Register bits. */
+#define BMC_START 0x01          /* Start transfer. */
+#define BMC_READ 0x08           /* Transfer from disk to memory. */
+
+/* Bus Master Status Register bits. */
+#define BMS_ERR 0x02            /* Error (write 1 to clear). */
+#define BMS_IRQ 0x04            /* Interrupt (write 1 to clear). */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +74,35 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+#define CMD_FLUSH_CACHE 0xe7            /* FLUSH CACHE. */
+
+/* A Physical Region Descriptor, which tells the bus master where
+   in physical memory to transfer data.  A region may not cross a
+   64 kB boundary. */
+struct prd
+  {
+    uint32_t addr;              /* Physical base address. */
+    uint16_t size;              /* Size in bytes (0 means 64 kB). */
+    uint16_t flags;             /* PRD_EOT in last entry. */
+  };
+#define PRD_EOT 0x8000          /* End of table. */
+#define PRD_CNT (PGSIZE / sizeof (struct prd))
+
+/* Most sectors to transfer with one command.  (The sector count
+   register is 8 bits wide, with 0 meaning 256.) */
+#define MAX_XFER_SECTORS 128
+
+/* Sectors that fit in a channel's DMA bounce buffer. */
+#define BOUNCE_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Most sectors per interrupt that we use for READ/WRITE
+   MULTIPLE. */
+#define MAX_MULTIPLE 16
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +111,9 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    bool dma;                   /* Use DMA for transfers? */
+    int multiple;               /* Sectors per READ/WRITE MULTIPLE block,
+                                   or 0 to use READ/WRITE SECTOR. */
   };
 
 /* An ATA channel (aka controller).
@@ -72,6 +129,12 @@ struct channel
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    /* Bus master DMA, if bm_base is nonzero. */
+    uint16_t bm_base;           /* Bus master base I/O port. */
+    uint8_t bm_status;          /* Status saved by interrupt handler. */
+    struct prd *prdt;           /* PRD table (one page). */
+    uint8_t *bounce;            /* Buffer for unaddressable data (one page). */
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
@@ -81,14 +144,25 @@ static struct channel channels[CHANNEL_CNT];
 
 static struct block_operations ide_operations;
 
+static uint16_t find_bus_master (void);
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
-
-static void select_sector (struct ata_disk *, block_sector_t);
-static void issue_pio_command (struct channel *, uint8_t command);
+static void set_multiple_mode (struct ata_disk *, int cnt);
+
+static void transfer (struct ata_disk *, block_sector_t, size_t cnt,
+                      uint8_t *, bool write);
+static void pio_read (struct ata_disk *, block_sector_t, size_t cnt,
+                      uint8_t *);
+static void pio_write (struct ata_disk *, block_sector_t, size_t cnt,
+                       const uint8_t *);
+static void select_sector (struct ata_disk *, block_sector_t, size_t cnt);
+static void issue_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
+static bool dma_addressable (const void *);
+static bool dma_transfer (struct ata_disk *, block_sector_t, size_t cnt,
+                          void *, bool write);
 
 static void wait_until_idle (const struct ata_disk *);
 static bool wait_while_busy (const struct ata_disk *);
@@ -101,6 +175,7 @@ static void interrupt_handler (struct intr_frame *);
 void
 ide_init (void) 
 {
+  uint16_t bm_base = find_bus_master ();
   size_t chan_no;
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
@@ -126,6 +201,14 @@ ide_init (void)
       lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+
+      /* Each channel has 8 bus master registers. */
+      c->bm_base = bm_base != 0 ? bm_base + chan_no * 8 : 0;
+      if (c->bm_base != 0)
+        {
+          c->prdt = palloc_get_page (PAL_ASSERT);
+          c->bounce = palloc_get_page (PAL_ASSERT);
+        }
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,6 +219,8 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->dma = false;
+          d->multiple = 0;
         }
 
       /* Register interrupt handler. */
@@ -159,6 +244,38 @@ ide_init (void)
 
 static char *descramble_ata_string (char *, int size);
 
+/* Looks for a PCI IDE controller that can act as a bus master
+   for the legacy channels and enables bus mastering on it.
+   Returns the base of its bus master registers, or 0 if there is
+   no such controller. */
+static uint16_t
+find_bus_master (void) 
+{
+  struct pci_dev pci;
+  uint32_t class, command;
+  uint16_t bm_base;
+
+  if (!pci_find_class (0x01, 0x01, &pci))
+    return 0;
+
+  /* Programming interface bit 7 says the controller is a bus
+     master.  Bits 0 and 2 say whether the channels are in native
+     PCI mode, in which case they don't use the legacy ports and
+     IRQs that we assume. */
+  class = pci_read_config (&pci, PCI_REG_CLASS);
+  if (!(class & 0x8000) || (class & 0x0500))
+    return 0;
+
+  bm_base = pci_io_bar (&pci, 4);
+  if (bm_base == 0)
+    return 0;
+
+  command = pci_read_config (&pci, PCI_REG_COMMAND);
+  pci_write_config (&pci, PCI_REG_COMMAND,
+                    (command & 0xffff) | PCI_CMD_IO | PCI_CMD_MASTER);
+  return bm_base;
+}
+
 /* Resets an ATA channel and waits for any devices present on it
    to finish the reset. */
 static void
@@ -265,6 +382,7 @@ identify_ata_device (struct ata_disk *d)
   char *model, *serial;
   char extra_info[128];
   struct block *block;
+  int multiple;
 
   ASSERT (d->is_ata);
 
@@ -272,7 +390,7 @@ identify_ata_device (struct ata_disk *d)
      indicating the device's response is ready, and read the data
      into our buffer. */
   select_device_wait (d);
-  issue_pio_command (c, CMD_IDENTIFY_DEVICE);
+  issue_command (c, CMD_IDENTIFY_DEVICE);
   sema_down (&c->completion_wait);
   if (!wait_while_busy (d))
     {
@@ -286,8 +404,23 @@ identify_ata_device (struct ata_disk *d)
   capacity = *(uint32_t *) &id[60 * 2];
   model = descramble_ata_string (&id[10 * 2], 20);
   serial = descramble_ata_string (&id[27 * 2], 40);
+
+  /* Word 47 bits 7:0 give the most sectors the disk can move per
+     interrupt with READ/WRITE MULTIPLE, or 0 if it can't. */
+  multiple = (uint8_t) id[47 * 2];
+  if (multiple > 1) 
+    {
+      int cnt = 1;
+      while (cnt * 2 <= multiple && cnt * 2 <= MAX_MULTIPLE)
+        cnt *= 2;
+      set_multiple_mode (d, cnt);
+    }
+
+  /* Word 49 bit 8 says whether the disk supports DMA. */
+  d->dma = c->bm_base != 0 && (*(uint16_t *) &id[49 * 2] & 0x0100) != 0;
   snprintf (extra_info, sizeof extra_info,
-            "model \"%s\", serial \"%s\"", model, serial);
+            "model \"%s\", serial \"%s\"%s", model, serial,
+            d->dma ? ", DMA" : "");
 
   /* Disable access to IDE disks over 1 GB, which are likely
      physical IDE disks rather than virtual ones.  If we don't
@@ -306,9 +439,27 @@ identify_ata_device (struct ata_disk *d)
   /* Register. */
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
                           &ide_operations, d);
+  block_set_bus (block, c - channels);
   partition_scan (block);
 }
 
+/* Tells disk D to transfer CNT sectors per interrupt in READ
+   MULTIPLE and WRITE MULTIPLE commands, and records CNT in D if
+   the disk accepts it. */
+static void
+set_multiple_mode (struct ata_disk *d, int cnt) 
+{
+  struct channel *c = d->channel;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), cnt);
+  issue_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  if (!(inb (reg_alt_status (c)) & STA_ERR))
+    d->multiple = cnt;
+}
+
 /* Translates STRING, which consists of SIZE bytes in a funky
    format, into a null-terminated string in-place.  Drops
    trailing whitespace and null bytes.  Returns STRING.  */
@@ -344,16 +495,7 @@ descramble_ata_string (char *string, int size)
 static void
 ide_read (void *d_, block_sector_t sec_no, void *buffer)
 {
-  struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  lock_release (&c->lock);
+  transfer (d_, sec_no, 1, buffer, false);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -363,37 +505,150 @@ ide_read (void *d_, block_sector_t sec_no, void *buffer)
    per-disk locking is unneeded. */
 static void
 ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+{
+  transfer (d_, sec_no, 1, (void *) buffer, true);
+}
+
+/* Reads CNT sectors starting at SEC_NO from disk D into BUFFER,
+   which must have room for CNT * BLOCK_SECTOR_SIZE bytes. */
+static void
+ide_read_multiple (void *d_, block_sector_t sec_no, size_t cnt, void *buffer)
+{
+  transfer (d_, sec_no, cnt, buffer, false);
+}
+
+/* Writes CNT sectors starting at SEC_NO to disk D from BUFFER,
+   which must contain CNT * BLOCK_SECTOR_SIZE bytes.  Returns
+   after the disk has acknowledged receiving the data. */
+static void
+ide_write_multiple (void *d_, block_sector_t sec_no, size_t cnt,
+                    const void *buffer)
+{
+  transfer (d_, sec_no, cnt, (void *) buffer, true);
+}
+
+/* Tells disk D to write any data in its write cache to the
+   medium, and returns once it has.  Drives without a write cache
+   reject the command, which is harmless. */
+static void
+ide_flush (void *d_)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
+  select_device_wait (d);
+  issue_command (c, CMD_FLUSH_CACHE);
   sema_down (&c->completion_wait);
+  wait_while_busy (d);
   lock_release (&c->lock);
 }
 
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multiple,
+    ide_write_multiple,
+    ide_flush
   };
+
+/* Transfers CNT sectors starting at SEC_NO between disk D and
+   BUFFER, by DMA if possible and otherwise by PIO, issuing as few
+   commands as the hardware allows. */
+static void
+transfer (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+          uint8_t *buffer, bool write) 
+{
+  struct channel *c = d->channel;
+
+  while (cnt > 0) 
+    {
+      size_t n = cnt < MAX_XFER_SECTORS ? cnt : MAX_XFER_SECTORS;
+
+      lock_acquire (&c->lock);
+      if (d->dma && !dma_addressable (buffer) && n > BOUNCE_SECTORS)
+        n = BOUNCE_SECTORS;
+      if (!d->dma || !dma_transfer (d, sec_no, n, buffer, write))
+        {
+          if (write)
+            pio_write (d, sec_no, n, buffer);
+          else
+            pio_read (d, sec_no, n, buffer);
+        }
+      lock_release (&c->lock);
+
+      sec_no += n;
+      cnt -= n;
+      buffer += n * BLOCK_SECTOR_SIZE;
+    }
+}
+
+/* Reads CNT sectors starting at SEC_NO from disk D into BUFFER
+   by PIO.  The caller must hold the channel lock. */
+static void
+pio_read (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+          uint8_t *buffer) 
+{
+  struct channel *c = d->channel;
+  size_t block_cnt = d->multiple > 1 ? d->multiple : 1;
+  size_t i;
+
+  /* The disk interrupts whenever a block of BLOCK_CNT sectors
+     (or the short final block) is ready to be read. */
+  select_sector (d, sec_no, cnt);
+  issue_command (c, (block_cnt > 1
+                     ? CMD_READ_MULTIPLE : CMD_READ_SECTOR_RETRY));
+  for (i = 0; i < cnt; i++)
+    {
+      if (i % block_cnt == 0)
+        sema_down (&c->completion_wait);
+      if (!wait_while_busy (d))
+        PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no + i);
+      input_sector (c, buffer + i * BLOCK_SECTOR_SIZE);
+    }
+}
+
+/* Writes CNT sectors starting at SEC_NO to disk D from BUFFER
+   by PIO.  The caller must hold the channel lock. */
+static void
+pio_write (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+           const uint8_t *buffer) 
+{
+  struct channel *c = d->channel;
+  size_t block_cnt = d->multiple > 1 ? d->multiple : 1;
+  size_t i;
+
+  /* The disk interrupts after accepting each block of BLOCK_CNT
+     sectors, to ask for the next block or to report that the
+     last one has been written. */
+  select_sector (d, sec_no, cnt);
+  issue_command (c, (block_cnt > 1
+                     ? CMD_WRITE_MULTIPLE : CMD_WRITE_SECTOR_RETRY));
+  for (i = 0; i < cnt; i++)
+    {
+      if (i > 0 && i % block_cnt == 0)
+        sema_down (&c->completion_wait);
+      if (!wait_while_busy (d))
+        PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no + i);
+      output_sector (c, buffer + i * BLOCK_SECTOR_SIZE);
+    }
+  sema_down (&c->completion_wait);
+}
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and CNT to the disk's sector selection and
+   sector count registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= MAX_XFER_SECTORS);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -404,7 +659,7 @@ select_sector (struct ata_disk *d, block_sector_t sec_no)
 /* Writes COMMAND to channel C and prepares for receiving a
    completion interrupt. */
 static void
-issue_pio_command (struct channel *c, uint8_t command) 
+issue_command (struct channel *c, uint8_t command) 
 {
   /* Interrupts must be enabled or our semaphore will never be
      up'd by the completion handler. */
@@ -430,6 +685,94 @@ output_sector (struct channel *c, const void *sector)
   outsw (reg_data (c), sector, BLOCK_SECTOR_SIZE / 2);
 }
 
+/* Returns true if the bus master can transfer directly to or
+   from BUFFER.  It needs a word-aligned physical address, which
+   we only know for kernel virtual addresses. */
+static bool
+dma_addressable (const void *buffer) 
+{
+  return is_kernel_vaddr (buffer) && ((uintptr_t) buffer & 1) == 0;
+}
+
+/* Fills C's PRD table to describe the SIZE bytes at BUFFER, a
+   kernel virtual address.  Kernel virtual memory maps physical
+   memory contiguously, so we only need to split the buffer at
+   64 kB boundaries. */
+static void
+build_prdt (struct channel *c, const void *buffer, size_t size) 
+{
+  uintptr_t phys = vtop (buffer);
+  size_t i;
+
+  for (i = 0; size > 0; i++)
+    {
+      size_t chunk = 0x10000 - (phys & 0xffff);
+      if (chunk > size)
+        chunk = size;
+
+      ASSERT (i < PRD_CNT);
+      c->prdt[i].addr = phys;
+      c->prdt[i].size = chunk;
+      c->prdt[i].flags = 0;
+
+      phys += chunk;
+      size -= chunk;
+    }
+  c->prdt[i - 1].flags = PRD_EOT;
+}
+
+/* Transfers CNT sectors starting at SEC_NO of disk D to or from
+   BUFFER by DMA.  Data that the bus master can't address goes
+   through the channel's bounce buffer, in which case CNT may not
+   exceed BOUNCE_SECTORS.  The caller must hold the channel
+   lock.  Returns true if successful.  On failure, disables DMA
+   on D and returns false, so that the caller can retry with
+   PIO. */
+static bool
+dma_transfer (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+              void *buffer, bool write) 
+{
+  struct channel *c = d->channel;
+  void *dma_buffer = dma_addressable (buffer) ? buffer : c->bounce;
+  size_t size = cnt * BLOCK_SECTOR_SIZE;
+  uint8_t direction = write ? 0 : BMC_READ;
+  uint8_t status;
+
+  ASSERT (dma_buffer == buffer || cnt <= BOUNCE_SECTORS);
+
+  if (write && dma_buffer != buffer)
+    memcpy (dma_buffer, buffer, size);
+  build_prdt (c, dma_buffer, size);
+
+  /* Point the bus master at the PRD table, clear any stale error
+     and interrupt status, and set the transfer direction. */
+  outb (reg_bm_command (c), 0);
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_status (c), inb (reg_bm_status (c)) | BMS_ERR | BMS_IRQ);
+  outb (reg_bm_command (c), direction);
+
+  /* Issue the command to the disk, then start the bus master and
+     wait for the disk to interrupt when the transfer is done. */
+  select_sector (d, sec_no, cnt);
+  issue_command (c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb (reg_bm_command (c), direction | BMC_START);
+  sema_down (&c->completion_wait);
+  outb (reg_bm_command (c), 0);
+
+  status = inb (reg_alt_status (c));
+  if ((c->bm_status & BMS_ERR) || (status & (STA_ERR | STA_DF)))
+    {
+      printf ("%s: DMA %s failed, sector=%"PRDSNu", using PIO\n",
+              d->name, write ? "write" : "read", sec_no);
+      d->dma = false;
+      return false;
+    }
+
+  if (!write && dma_buffer != buffer)
+    memcpy (buffer, dma_buffer, size);
+  return true;
+}
+
 /* Low-level ATA primitives. */
 
 /* Wait up to 10 seconds for the controller to become idle, that
@@ -514,6 +857,12 @@ interrupt_handler (struct intr_frame *f)
         if (c->expecting_interrupt) 
           {
             inb (reg_status (c));               /* Acknowledge interrupt. */
+            if (c->bm_base != 0) 
+              {
+                /* Save and clear bus master status. */
+                c->bm_status = inb (reg_bm_status (c));
+                outb (reg_bm_status (c), c->bm_status);
+              }
             sema_up (&c->completion_wait);      /* Wake up waiter. */
           }
         else
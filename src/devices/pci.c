@@ -0,0 +1,118 @@
+#include "devices/pci.h"
+#include <debug.h>
+#include "threads/io.h"
+
+/* Minimal access to PCI configuration space through the legacy
+   "configuration mechanism #1" ports, enough for drivers to find
+   their controller and read its resources.  See [PCI], section
+   3.2.2.3.2. */
+
+/* Configuration mechanism #1 ports. */
+#define PCI_CONFIG_ADDR 0xcf8   /* Selects a register. */
+#define PCI_CONFIG_DATA 0xcfc   /* Reads or writes the register. */
+
+/* Returns the configuration address for register REG of D. */
+static uint32_t
+config_addr (const struct pci_dev *d, uint8_t reg)
+{
+  ASSERT (reg % 4 == 0);
+  return (0x80000000u | ((uint32_t) d->bus << 16) | ((uint32_t) d->dev << 11)
+          | ((uint32_t) d->func << 8) | reg);
+}
+
+/* Returns the 32-bit configuration register REG of D. */
+uint32_t
+pci_read_config (const struct pci_dev *d, uint8_t reg)
+{
+  outl (PCI_CONFIG_ADDR, config_addr (d, reg));
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to the 32-bit configuration register REG of D. */
+void
+pci_write_config (const struct pci_dev *d, uint8_t reg, uint32_t value)
+{
+  outl (PCI_CONFIG_ADDR, config_addr (d, reg));
+  outl (PCI_CONFIG_DATA, value);
+}
+
+/* Returns the I/O port base of D's base address register BAR, or
+   0 if BAR is unused or maps memory rather than I/O ports. */
+uint16_t
+pci_io_bar (const struct pci_dev *d, int bar)
+{
+  uint32_t value;
+
+  ASSERT (bar >= 0 && bar < 6);
+  value = pci_read_config (d, PCI_REG_BAR (bar));
+  return (value & 1) ? value & ~3u : 0;
+}
+
+/* Calls FUNC with each PCI function in bus order, passing AUX
+   along, until FUNC returns true.  If it does, stores that PCI
+   function in *D and returns true.  Otherwise returns false. */
+bool
+pci_scan (pci_scan_func *func, void *aux, struct pci_dev *d)
+{
+  int bus, dev, func_no;
+
+  for (bus = 0; bus < 256; bus++)
+    for (dev = 0; dev < 32; dev++)
+      for (func_no = 0; func_no < 8; func_no++)
+        {
+          d->bus = bus;
+          d->dev = dev;
+          d->func = func_no;
+          if ((pci_read_config (d, PCI_REG_ID) & 0xffff) == 0xffff)
+            {
+              /* No function 0 means no device at all. */
+              if (func_no == 0)
+                break;
+              continue;
+            }
+          if (func (d, aux))
+            return true;
+
+          /* Only multi-function devices have functions 1...7. */
+          if (func_no == 0
+              && !(pci_read_config (d, PCI_REG_HEADER) & 0x00800000))
+            break;
+        }
+  return false;
+}
+
+/* pci_scan() function for pci_find_class().  AUX points to the
+   class code in bits 15:8 and the subclass code in bits 7:0. */
+static bool
+class_matches (const struct pci_dev *d, void *aux)
+{
+  const uint32_t *class = aux;
+  return (pci_read_config (d, PCI_REG_CLASS) >> 16) == *class;
+}
+
+/* Finds the first PCI function with the given CLASS and SUBCLASS
+   codes and stores it in *D.  Returns true if successful. */
+bool
+pci_find_class (uint8_t class, uint8_t subclass, struct pci_dev *d)
+{
+  uint32_t code = (class << 8) | subclass;
+  return pci_scan (class_matches, &code, d);
+}
+
+/* pci_scan() function for pci_find_device().  AUX points to the
+   device ID in bits 31:16 and the vendor ID in bits 15:0. */
+static bool
+id_matches (const struct pci_dev *d, void *aux)
+{
+  const uint32_t *id = aux;
+  return pci_read_config (d, PCI_REG_ID) == *id;
+}
+
+/* Finds the first PCI function with the given VENDOR and DEVICE
+   IDs and stores it in *D.  Returns true if successful. */
+bool
+pci_find_device (uint16_t vendor, uint16_t device, struct pci_dev *d)
+{
+  uint32_t id = ((uint32_t) device << 16) | vendor;
+  return pci_scan (id_matches, &id, d);
+}
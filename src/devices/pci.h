@@ -0,0 +1,41 @@
+#ifndef DEVICES_PCI_H
+#define DEVICES_PCI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* A PCI function, identified by its position on the bus. */
+struct pci_dev
+  {
+    uint8_t bus;                /* Bus number, 0...255. */
+    uint8_t dev;                /* Device number, 0...31. */
+    uint8_t func;               /* Function number, 0...7. */
+  };
+
+/* Configuration space registers common to all header types.
+   Offsets are in bytes and must be multiples of 4. */
+#define PCI_REG_ID 0x00         /* Device ID 31:16, vendor ID 15:0. */
+#define PCI_REG_COMMAND 0x04    /* Status 31:16, command 15:0. */
+#define PCI_REG_CLASS 0x08      /* Class, subclass, prog IF, revision. */
+#define PCI_REG_HEADER 0x0c     /* Header type 23:16. */
+#define PCI_REG_BAR(N) (0x10 + 4 * (N)) /* Base address register N. */
+#define PCI_REG_INTR 0x3c       /* Interrupt pin 15:8, line 7:0. */
+
+/* Command register bits. */
+#define PCI_CMD_IO 0x0001       /* Respond to I/O space accesses. */
+#define PCI_CMD_MEM 0x0002      /* Respond to memory space accesses. */
+#define PCI_CMD_MASTER 0x0004   /* May act as a bus master (DMA). */
+
+/* Called by pci_scan() for each PCI function.  Returns true to
+   stop the scan. */
+typedef bool pci_scan_func (const struct pci_dev *, void *aux);
+
+bool pci_scan (pci_scan_func *, void *aux, struct pci_dev *);
+bool pci_find_class (uint8_t class, uint8_t subclass, struct pci_dev *);
+bool pci_find_device (uint16_t vendor, uint16_t device, struct pci_dev *);
+
+uint32_t pci_read_config (const struct pci_dev *, uint8_t reg);
+void pci_write_config (const struct pci_dev *, uint8_t reg, uint32_t);
+uint16_t pci_io_bar (const struct pci_dev *, int bar);
+
+#endif /* devices/pci.h */
@@ -0,0 +1,117 @@
+#include "devices/ramdisk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* A block device kept in kernel memory, which transfers sectors
+   with memcpy() and so has no latency beyond that of the layers
+   above it.  Useful for profiling the file system and VM without
+   disk cost, or as scratch space.  Its contents are lost at
+   power off. */
+
+/* Sectors per page. */
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* A RAM disk. */
+struct ramdisk
+  {
+    uint8_t **pages;            /* Pages holding the data. */
+  };
+
+static struct block_operations ramdisk_operations;
+
+/* Creates a KB-kilobyte RAM disk named "rd0", filled with zeros,
+   and registers it with the block layer.  Panics if there isn't
+   enough kernel memory for it. */
+void
+ramdisk_init (size_t kb)
+{
+  size_t page_cnt = DIV_ROUND_UP (kb * 1024, PGSIZE);
+  struct ramdisk *rd;
+  size_t i;
+
+  if (page_cnt == 0)
+    return;
+
+  rd = malloc (sizeof *rd);
+  if (rd != NULL)
+    rd->pages = malloc (page_cnt * sizeof *rd->pages);
+  if (rd == NULL || rd->pages == NULL)
+    PANIC ("Failed to allocate memory for RAM disk descriptor");
+
+  /* Allocate every page up front, so that the cost of
+     allocation doesn't show up in measurements. */
+  for (i = 0; i < page_cnt; i++)
+    {
+      rd->pages[i] = palloc_get_page (PAL_ZERO);
+      if (rd->pages[i] == NULL)
+        PANIC ("rd0: out of memory after %zu of %zu kB",
+               i * PGSIZE / 1024, page_cnt * PGSIZE / 1024);
+    }
+
+  block_register ("rd0", BLOCK_RAW, "RAM disk",
+                  page_cnt * SECTORS_PER_PAGE, &ramdisk_operations, rd);
+}
+
+/* Returns the address of sector SECTOR of RD. */
+static uint8_t *
+sector_addr (struct ramdisk *rd, block_sector_t sector)
+{
+  return (rd->pages[sector / SECTORS_PER_PAGE]
+          + sector % SECTORS_PER_PAGE * BLOCK_SECTOR_SIZE);
+}
+
+/* Reads CNT sectors starting at SECTOR from RD_ into BUFFER. */
+static void
+ramdisk_read_multiple (void *rd_, block_sector_t sector, size_t cnt,
+                       void *buffer_)
+{
+  uint8_t *buffer = buffer_;
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    memcpy (buffer + i * BLOCK_SECTOR_SIZE, sector_addr (rd_, sector + i),
+            BLOCK_SECTOR_SIZE);
+}
+
+/* Writes CNT sectors starting at SECTOR to RD_ from BUFFER. */
+static void
+ramdisk_write_multiple (void *rd_, block_sector_t sector, size_t cnt,
+                        const void *buffer_)
+{
+  const uint8_t *buffer = buffer_;
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    memcpy (sector_addr (rd_, sector + i), buffer + i * BLOCK_SECTOR_SIZE,
+            BLOCK_SECTOR_SIZE);
+}
+
+/* Reads sector SECTOR from RD_ into BUFFER. */
+static void
+ramdisk_read (void *rd_, block_sector_t sector, void *buffer)
+{
+  ramdisk_read_multiple (rd_, sector, 1, buffer);
+}
+
+/* Writes sector SECTOR to RD_ from BUFFER. */
+static void
+ramdisk_write (void *rd_, block_sector_t sector, const void *buffer)
+{
+  ramdisk_write_multiple (rd_, sector, 1, buffer);
+}
+
+static struct block_operations ramdisk_operations =
+  {
+    ramdisk_read,
+    ramdisk_write,
+    ramdisk_read_multiple,
+    ramdisk_write_multiple,
+    NULL                        /* Nothing to flush. */
+  };
@@ -0,0 +1,217 @@
+#include "devices/stripe.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* A striped ("RAID-0") block device built from other block
+   devices, its "members".  Consecutive chunks of CHUNK_SECTORS
+   sectors are laid out round-robin across the members, so a
+   large transfer is split into pieces that the members carry
+   out in parallel when they are on different buses. */
+
+/* Sectors per chunk.  A page's worth, so that a page-sized
+   transfer touches a single member. */
+#define CHUNK_SECTORS 8
+
+/* Most members in a stripe. */
+#define MAX_MEMBERS 8
+
+/* A striped device. */
+struct stripe
+  {
+    struct block *members[MAX_MEMBERS]; /* Member devices. */
+    size_t member_cnt;                  /* Number of members. */
+  };
+
+static struct block_operations stripe_operations;
+
+/* Creates a striped block device called NAME over the
+   comma-separated list of block device names in MEMBERS, and
+   registers it with the block layer.  MEMBERS is modified.
+   Panics if a member does not exist. */
+void
+stripe_create (const char *name, char *members)
+{
+  struct stripe *s;
+  block_sector_t member_size = 0;
+  char extra_info[128] = "stripe of";
+  char *member, *save_ptr;
+  size_t i;
+
+  s = malloc (sizeof *s);
+  if (s == NULL)
+    PANIC ("Failed to allocate memory for stripe descriptor");
+  s->member_cnt = 0;
+
+  for (member = strtok_r (members, ",", &save_ptr); member != NULL;
+       member = strtok_r (NULL, ",", &save_ptr))
+    {
+      struct block *block = block_get_by_name (member);
+      if (block == NULL)
+        PANIC ("%s: no such block device \"%s\"", name, member);
+      if (s->member_cnt >= MAX_MEMBERS)
+        PANIC ("%s: too many members", name);
+      for (i = 0; i < s->member_cnt; i++)
+        if (s->members[i] == block)
+          PANIC ("%s: %s given twice", name, member);
+      if (s->member_cnt == 0 || block_size (block) < member_size)
+        member_size = block_size (block);
+      s->members[s->member_cnt++] = block;
+
+      strlcat (extra_info, s->member_cnt > 1 ? ", " : " ", sizeof extra_info);
+      strlcat (extra_info, member, sizeof extra_info);
+    }
+  if (s->member_cnt == 0)
+    PANIC ("%s: no members", name);
+
+  /* Use the same whole number of chunks from each member. */
+  member_size = ROUND_DOWN (member_size, CHUNK_SECTORS);
+  block_register (name, BLOCK_RAW, extra_info, member_size * s->member_cnt,
+                  &stripe_operations, s);
+}
+
+/* Returns the member of S that holds SECTOR and stores the
+   corresponding sector within that member in *MEMBER_SECTOR. */
+static struct block *
+map_sector (const struct stripe *s, block_sector_t sector,
+            block_sector_t *member_sector)
+{
+  block_sector_t chunk = sector / CHUNK_SECTORS;
+
+  *member_sector = (chunk / s->member_cnt * CHUNK_SECTORS
+                    + sector % CHUNK_SECTORS);
+  return s->members[chunk % s->member_cnt];
+}
+
+/* Transfers CNT sectors starting at SECTOR between stripe S and
+   BUFFER.  Each chunk-sized piece goes to its member as an
+   asynchronous request, and then we wait for all of them, so
+   that members on different buses work at the same time.
+
+   Asynchronous requests are carried out by the members' worker
+   threads, outside the caller's address space, so a BUFFER in
+   user memory is first copied through kernel pages.  If none are
+   available, the pieces are transferred one at a time from the
+   calling thread instead. */
+static void
+transfer (struct stripe *s, block_sector_t sector, size_t cnt,
+          uint8_t *buffer, bool write)
+{
+  size_t piece_cnt = DIV_ROUND_UP (sector % CHUNK_SECTORS + cnt,
+                                   CHUNK_SECTORS);
+  size_t size = cnt * BLOCK_SECTOR_SIZE;
+  size_t page_cnt = DIV_ROUND_UP (size, PGSIZE);
+  struct block_request *pieces = NULL;
+  uint8_t *bounce = NULL;
+  uint8_t *p;
+  size_t i;
+
+  if (piece_cnt > 1 && !is_kernel_vaddr (buffer))
+    {
+      bounce = palloc_get_multiple (0, page_cnt);
+      if (bounce != NULL && write)
+        memcpy (bounce, buffer, size);
+    }
+  p = bounce != NULL ? bounce : buffer;
+  if (piece_cnt > 1 && is_kernel_vaddr (p))
+    pieces = malloc (piece_cnt * sizeof *pieces);
+
+  for (i = 0; cnt > 0; i++)
+    {
+      size_t n = CHUNK_SECTORS - sector % CHUNK_SECTORS;
+      block_sector_t member_sector;
+      struct block *member = map_sector (s, sector, &member_sector);
+
+      if (n > cnt)
+        n = cnt;
+      if (pieces != NULL)
+        {
+          struct block_request *r = &pieces[i];
+          r->write = write;
+          r->sector = member_sector;
+          r->cnt = n;
+          r->buffer = p;
+          r->callback = NULL;
+          block_submit (member, r);
+        }
+      else if (write)
+        block_write_multiple (member, member_sector, n, p);
+      else
+        block_read_multiple (member, member_sector, n, p);
+
+      sector += n;
+      cnt -= n;
+      p += n * BLOCK_SECTOR_SIZE;
+    }
+
+  if (pieces != NULL)
+    {
+      for (i = 0; i < piece_cnt; i++)
+        block_wait (&pieces[i]);
+      free (pieces);
+    }
+
+  if (bounce != NULL)
+    {
+      if (!write)
+        memcpy (buffer, bounce, size);
+      palloc_free_multiple (bounce, page_cnt);
+    }
+}
+
+/* Reads sector SECTOR from stripe S_ into BUFFER. */
+static void
+stripe_read (void *s_, block_sector_t sector, void *buffer)
+{
+  transfer (s_, sector, 1, buffer, false);
+}
+
+/* Writes sector SECTOR to stripe S_ from BUFFER. */
+static void
+stripe_write (void *s_, block_sector_t sector, const void *buffer)
+{
+  transfer (s_, sector, 1, (void *) buffer, true);
+}
+
+/* Reads CNT sectors starting at SECTOR from stripe S_ into
+   BUFFER. */
+static void
+stripe_read_multiple (void *s_, block_sector_t sector, size_t cnt,
+                      void *buffer)
+{
+  transfer (s_, sector, cnt, buffer, false);
+}
+
+/* Writes CNT sectors starting at SECTOR to stripe S_ from
+   BUFFER. */
+static void
+stripe_write_multiple (void *s_, block_sector_t sector, size_t cnt,
+                       const void *buffer)
+{
+  transfer (s_, sector, cnt, (void *) buffer, true);
+}
+
+/* Flushes the write cache of each member of stripe S_. */
+static void
+stripe_flush (void *s_)
+{
+  struct stripe *s = s_;
+  size_t i;
+
+  for (i = 0; i < s->member_cnt; i++)
+    block_flush (s->members[i]);
+}
+
+static struct block_operations stripe_operations =
+  {
+    stripe_read,
+    stripe_write,
+    stripe_read_multiple,
+    stripe_write_multiple,
+    stripe_flush
+  };
@@ -0,0 +1,468 @@
+#include "devices/virtio-blk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/partition.h"
+#include "devices/pci.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Driver for virtio block devices, the paravirtualized disks
+   offered by QEMU and other hypervisors.  A request is described
+   to the device in a shared-memory ring (the "virtqueue") and
+   announced with a single register write, instead of the dozen
+   or so emulated register accesses per sector that an IDE
+   transfer takes, and several requests may be outstanding at
+   once.  See [VIRTIO].
+
+   We use the "legacy" interface, through I/O ports in BAR 0,
+   which QEMU's default "transitional" virtio-blk-pci devices
+   provide.  Modern-only devices, which are configured through
+   memory-mapped PCI capabilities instead, are not supported. */
+
+/* PCI IDs of a transitional virtio block device. */
+#define VIRTIO_VENDOR 0x1af4
+#define VIRTIO_BLK_DEVICE 0x1001
+
+/* Legacy virtio registers, relative to BAR 0. */
+#define REG_DEVICE_FEATURES 0x00        /* Device features (32 bits). */
+#define REG_GUEST_FEATURES 0x04         /* Guest features (32 bits). */
+#define REG_QUEUE_PFN 0x08              /* Queue page frame (32 bits). */
+#define REG_QUEUE_SIZE 0x0c             /* Queue size (16 bits). */
+#define REG_QUEUE_SELECT 0x0e           /* Queue select (16 bits). */
+#define REG_QUEUE_NOTIFY 0x10           /* Queue notify (16 bits). */
+#define REG_STATUS 0x12                 /* Device status (8 bits). */
+#define REG_ISR 0x13                    /* ISR status (8 bits). */
+#define REG_CAPACITY 0x14               /* Capacity in sectors (64 bits). */
+
+/* Feature bits. */
+#define VIRTIO_BLK_F_FLUSH (1u << 9)    /* Has a write cache to flush. */
+
+/* Device status bits. */
+#define STATUS_ACKNOWLEDGE 0x01         /* We noticed the device. */
+#define STATUS_DRIVER 0x02              /* We can drive it. */
+#define STATUS_DRIVER_OK 0x04           /* Driver is ready. */
+#define STATUS_FAILED 0x80              /* We gave up on it. */
+
+/* ISR status bits. */
+#define ISR_QUEUE 0x01                  /* A virtqueue has used buffers. */
+
+/* A virtqueue descriptor, which points to one buffer. */
+struct vring_desc
+  {
+    uint64_t addr;              /* Physical address. */
+    uint32_t len;               /* Length in bytes. */
+    uint16_t flags;             /* VRING_DESC_F_*. */
+    uint16_t next;              /* Next descriptor if VRING_DESC_F_NEXT. */
+  };
+#define VRING_DESC_F_NEXT 1     /* Chained to NEXT. */
+#define VRING_DESC_F_WRITE 2    /* Device writes (rather than reads). */
+
+/* Ring of descriptor chains made available to the device. */
+struct vring_avail
+  {
+    uint16_t flags;
+    uint16_t idx;               /* Where we put the next entry. */
+    uint16_t ring[];            /* Heads of descriptor chains. */
+  };
+
+/* Ring of descriptor chains that the device is done with. */
+struct vring_used_elem
+  {
+    uint32_t id;                /* Head of descriptor chain. */
+    uint32_t len;               /* Bytes written by device. */
+  };
+struct vring_used
+  {
+    uint16_t flags;
+    uint16_t idx;               /* Where the device puts the next entry. */
+    struct vring_used_elem ring[];
+  };
+
+/* Header that starts each block request. */
+struct virtio_blk_req
+  {
+    uint32_t type;              /* VIRTIO_BLK_T_*. */
+    uint32_t reserved;
+    uint64_t sector;            /* First sector. */
+  };
+#define VIRTIO_BLK_T_IN 0       /* Read. */
+#define VIRTIO_BLK_T_OUT 1      /* Write. */
+#define VIRTIO_BLK_T_FLUSH 4    /* Flush write cache. */
+#define VIRTIO_BLK_S_OK 0       /* Status byte on success. */
+
+/* Most requests outstanding per device.  Each takes three
+   descriptors: header, data, and status. */
+#define SLOT_CNT 8
+
+/* Most sectors per request. */
+#define MAX_XFER_SECTORS 128
+
+/* Sectors that fit in a slot's bounce buffer. */
+#define BOUNCE_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* An outstanding request. */
+struct slot
+  {
+    struct virtio_blk_req req;  /* Request header, read by device. */
+    uint8_t status;             /* Status, written by device. */
+    bool busy;                  /* In use? */
+    struct semaphore done;      /* Up'd by interrupt handler. */
+    uint8_t *bounce;            /* Page for data we can't DMA directly. */
+  };
+
+/* A virtio block device. */
+struct vblk
+  {
+    char name[8];               /* Name, e.g. "vda". */
+    uint16_t io_base;           /* BAR 0 I/O port base. */
+    uint8_t irq;                /* Interrupt vector. */
+    bool flush;                 /* Device has a cache that needs flushing? */
+
+    /* Virtqueue. */
+    uint16_t queue_size;        /* Number of descriptors. */
+    struct vring_desc *desc;    /* Descriptor table. */
+    struct vring_avail *avail;  /* Available ring. */
+    struct vring_used *used;    /* Used ring. */
+    uint16_t last_used;         /* Next used entry to look at. */
+
+    struct lock lock;           /* Protects slots and avail ring. */
+    struct semaphore free_slots;        /* Number of free slots. */
+    int slot_cnt;               /* Number of slots. */
+    struct slot slots[SLOT_CNT];
+  };
+
+/* All the virtio block devices we found. */
+#define MAX_DEVICES 4
+static struct vblk *devices[MAX_DEVICES];
+static size_t device_cnt;
+
+static struct block_operations vblk_operations;
+
+static bool probe (const struct pci_dev *, void *aux);
+static bool setup_queue (struct vblk *);
+static void interrupt_handler (struct intr_frame *);
+
+/* Finds virtio block devices on the PCI bus and registers them
+   with the block layer. */
+void
+virtio_blk_init (void)
+{
+  struct pci_dev pci;
+
+  pci_scan (probe, NULL, &pci);
+}
+
+/* pci_scan() function that sets up PCI, if it is a virtio block
+   device.  Always returns false, to continue the scan. */
+static bool
+probe (const struct pci_dev *pci, void *aux UNUSED)
+{
+  static bool vec_registered[16];
+  struct vblk *d;
+  struct block *block;
+  uint32_t intr, command;
+  uint64_t capacity;
+  int i;
+
+  if (pci_read_config (pci, PCI_REG_ID)
+      != ((uint32_t) VIRTIO_BLK_DEVICE << 16 | VIRTIO_VENDOR))
+    return false;
+  if (device_cnt >= MAX_DEVICES)
+    {
+      printf ("virtio-blk: too many devices\n");
+      return false;
+    }
+
+  d = malloc (sizeof *d);
+  if (d == NULL)
+    PANIC ("Failed to allocate memory for virtio-blk descriptor");
+  snprintf (d->name, sizeof d->name, "vd%c", 'a' + (int) device_cnt);
+  d->io_base = pci_io_bar (pci, 0);
+  intr = pci_read_config (pci, PCI_REG_INTR) & 0xff;
+  if (d->io_base == 0 || intr >= 16)
+    {
+      printf ("%s: no I/O ports or interrupt, ignoring\n", d->name);
+      free (d);
+      return false;
+    }
+  d->irq = 0x20 + intr;
+
+  /* Enable I/O and DMA. */
+  command = pci_read_config (pci, PCI_REG_COMMAND);
+  pci_write_config (pci, PCI_REG_COMMAND,
+                    (command & 0xffff) | PCI_CMD_IO | PCI_CMD_MASTER);
+
+  /* Several devices may share an interrupt line. */
+  devices[device_cnt++] = d;
+  if (!vec_registered[intr])
+    {
+      intr_register_ext (d->irq, interrupt_handler, "virtio-blk");
+      vec_registered[intr] = true;
+    }
+
+  /* Reset the device, tell it we know how to drive it, and
+     decline all optional features except cache flushing.  A
+     device that has a write cache but isn't allowed to tell us
+     must write through it. */
+  outb (d->io_base + REG_STATUS, 0);
+  outb (d->io_base + REG_STATUS, STATUS_ACKNOWLEDGE);
+  outb (d->io_base + REG_STATUS, STATUS_ACKNOWLEDGE | STATUS_DRIVER);
+  d->flush = (inl (d->io_base + REG_DEVICE_FEATURES)
+              & VIRTIO_BLK_F_FLUSH) != 0;
+  outl (d->io_base + REG_GUEST_FEATURES, d->flush ? VIRTIO_BLK_F_FLUSH : 0);
+
+  lock_init (&d->lock);
+  if (!setup_queue (d))
+    {
+      printf ("%s: cannot set up virtqueue, ignoring\n", d->name);
+      outb (d->io_base + REG_STATUS, STATUS_FAILED);
+      device_cnt--;
+      free (d);
+      return false;
+    }
+  sema_init (&d->free_slots, d->slot_cnt);
+  for (i = 0; i < d->slot_cnt; i++)
+    {
+      struct slot *s = &d->slots[i];
+      s->busy = false;
+      sema_init (&s->done, 0);
+      s->bounce = palloc_get_page (PAL_ASSERT);
+    }
+  outb (d->io_base + REG_STATUS,
+        STATUS_ACKNOWLEDGE | STATUS_DRIVER | STATUS_DRIVER_OK);
+
+  /* Register. */
+  capacity = (inl (d->io_base + REG_CAPACITY)
+              | (uint64_t) inl (d->io_base + REG_CAPACITY + 4) << 32);
+  if (capacity > (block_sector_t) -1)
+    capacity = (block_sector_t) -1;
+  block = block_register (d->name, BLOCK_RAW, "virtio", capacity,
+                          &vblk_operations, d);
+  block_set_queue_depth (block, d->slot_cnt);
+  partition_scan (block);
+  return false;
+}
+
+/* Allocates and zeros virtqueue 0 for D in the legacy layout and
+   tells the device where it is.  Returns true if successful. */
+static bool
+setup_queue (struct vblk *d)
+{
+  size_t avail_end, ring_size;
+  uint8_t *ring;
+
+  outw (d->io_base + REG_QUEUE_SELECT, 0);
+  d->queue_size = inw (d->io_base + REG_QUEUE_SIZE);
+  if (d->queue_size < 3)
+    return false;
+  d->slot_cnt = d->queue_size / 3 < SLOT_CNT ? d->queue_size / 3 : SLOT_CNT;
+
+  /* The descriptor table and available ring come first, then the
+     used ring on the next page boundary. */
+  avail_end = (sizeof *d->desc * d->queue_size
+               + sizeof *d->avail + sizeof d->avail->ring[0] * d->queue_size
+               + sizeof (uint16_t));
+  ring_size = (ROUND_UP (avail_end, PGSIZE)
+               + ROUND_UP (sizeof *d->used
+                           + sizeof d->used->ring[0] * d->queue_size
+                           + sizeof (uint16_t), PGSIZE));
+  ring = palloc_get_multiple (PAL_ZERO, ring_size / PGSIZE);
+  if (ring == NULL)
+    return false;
+
+  d->desc = (struct vring_desc *) ring;
+  d->avail = (struct vring_avail *) (ring + sizeof *d->desc * d->queue_size);
+  d->used = (struct vring_used *) (ring + ROUND_UP (avail_end, PGSIZE));
+  d->last_used = 0;
+  outl (d->io_base + REG_QUEUE_PFN, vtop (ring) / PGSIZE);
+  return true;
+}
+
+/* Sends D a request of the given TYPE, which transfers CNT
+   sectors starting at SECTOR between the device and BUFFER, using
+   a bounce buffer if BOUNCE is true.  A flush request transfers
+   no data.  Waits for a free slot, if necessary, and then for the
+   request to complete.  Several threads may be in here at once,
+   up to the device's queue depth. */
+static void
+request (struct vblk *d, uint32_t type, block_sector_t sector, size_t cnt,
+         uint8_t *buffer, bool bounce)
+{
+  size_t size = cnt * BLOCK_SECTOR_SIZE;
+  bool write = type == VIRTIO_BLK_T_OUT;
+  struct vring_desc *desc;
+  struct slot *s;
+  uint8_t *data;
+  int i;
+
+  sema_down (&d->free_slots);
+  lock_acquire (&d->lock);
+  for (i = 0; d->slots[i].busy; i++)
+    ASSERT (i + 1 < d->slot_cnt);
+  s = &d->slots[i];
+  s->busy = true;
+  lock_release (&d->lock);
+
+  data = bounce ? s->bounce : buffer;
+  if (write && bounce)
+    memcpy (data, buffer, size);
+
+  /* Describe the request in slot I's three descriptors, leaving
+     out the data descriptor if there is no data. */
+  s->req.type = type;
+  s->req.reserved = 0;
+  s->req.sector = sector;
+  s->status = 0xff;
+  desc = &d->desc[i * 3];
+  desc[0].addr = vtop (&s->req);
+  desc[0].len = sizeof s->req;
+  desc[0].flags = VRING_DESC_F_NEXT;
+  desc[0].next = i * 3 + (cnt > 0 ? 1 : 2);
+  if (cnt > 0)
+    {
+      desc[1].addr = vtop (data);
+      desc[1].len = size;
+      desc[1].flags = VRING_DESC_F_NEXT | (write ? 0 : VRING_DESC_F_WRITE);
+      desc[1].next = i * 3 + 2;
+    }
+  desc[2].addr = vtop (&s->status);
+  desc[2].len = 1;
+  desc[2].flags = VRING_DESC_F_WRITE;
+  desc[2].next = 0;
+
+  /* Make it available and notify the device.  The device must
+     see the descriptors and ring entry before the new index. */
+  lock_acquire (&d->lock);
+  d->avail->ring[d->avail->idx % d->queue_size] = i * 3;
+  barrier ();
+  d->avail->idx++;
+  barrier ();
+  outw (d->io_base + REG_QUEUE_NOTIFY, 0);
+  lock_release (&d->lock);
+
+  sema_down (&s->done);
+  if (s->status != VIRTIO_BLK_S_OK)
+    PANIC ("%s: disk %s failed, sector=%"PRDSNu, d->name,
+           (type == VIRTIO_BLK_T_FLUSH ? "flush"
+            : write ? "write" : "read"), sector);
+  if (!write && bounce)
+    memcpy (buffer, data, size);
+
+  lock_acquire (&d->lock);
+  s->busy = false;
+  lock_release (&d->lock);
+  sema_up (&d->free_slots);
+}
+
+/* Transfers CNT sectors starting at SECTOR between device D and
+   BUFFER, in as few requests as possible.  The device can only
+   reach kernel virtual addresses, whose physical addresses we
+   know, so other buffers go through a bounce page. */
+static void
+transfer (struct vblk *d, block_sector_t sector, size_t cnt,
+          uint8_t *buffer, bool write)
+{
+  bool bounce = !is_kernel_vaddr (buffer);
+
+  while (cnt > 0)
+    {
+      size_t n = cnt < MAX_XFER_SECTORS ? cnt : MAX_XFER_SECTORS;
+      if (bounce && n > BOUNCE_SECTORS)
+        n = BOUNCE_SECTORS;
+
+      request (d, write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN, sector, n,
+               buffer, bounce);
+
+      sector += n;
+      cnt -= n;
+      buffer += n * BLOCK_SECTOR_SIZE;
+    }
+}
+
+/* Reads sector SECTOR from device D_ into BUFFER. */
+static void
+vblk_read (void *d_, block_sector_t sector, void *buffer)
+{
+  transfer (d_, sector, 1, buffer, false);
+}
+
+/* Writes sector SECTOR to device D_ from BUFFER. */
+static void
+vblk_write (void *d_, block_sector_t sector, const void *buffer)
+{
+  transfer (d_, sector, 1, (void *) buffer, true);
+}
+
+/* Reads CNT sectors starting at SECTOR from device D_ into
+   BUFFER. */
+static void
+vblk_read_multiple (void *d_, block_sector_t sector, size_t cnt,
+                    void *buffer)
+{
+  transfer (d_, sector, cnt, buffer, false);
+}
+
+/* Writes CNT sectors starting at SECTOR to device D_ from
+   BUFFER. */
+static void
+vblk_write_multiple (void *d_, block_sector_t sector, size_t cnt,
+                     const void *buffer)
+{
+  transfer (d_, sector, cnt, (void *) buffer, true);
+}
+
+/* Makes writes to device D_ that have completed durable. */
+static void
+vblk_flush (void *d_)
+{
+  struct vblk *d = d_;
+
+  if (d->flush)
+    request (d, VIRTIO_BLK_T_FLUSH, 0, 0, NULL, false);
+}
+
+static struct block_operations vblk_operations =
+  {
+    vblk_read,
+    vblk_write,
+    vblk_read_multiple,
+    vblk_write_multiple,
+    vblk_flush
+  };
+
+/* virtio-blk interrupt handler.  Wakes up the waiter for each
+   request that the device has finished, on every device that
+   uses this interrupt line. */
+static void
+interrupt_handler (struct intr_frame *f)
+{
+  size_t i;
+
+  for (i = 0; i < device_cnt; i++)
+    {
+      struct vblk *d = devices[i];
+
+      /* Reading the ISR status also acknowledges the interrupt. */
+      if (d->irq != f->vec_no
+          || !(inb (d->io_base + REG_ISR) & ISR_QUEUE))
+        continue;
+
+      barrier ();
+      while (d->last_used != d->used->idx)
+        {
+          struct vring_used_elem *e;
+
+          barrier ();
+          e = &d->used->ring[d->last_used % d->queue_size];
+          sema_up (&d->slots[e->id / 3].done);
+          d->last_used++;
+        }
+    }
+}
@@ -17,46 +17,56 @@ static bool
 list_dir (const char *dir, bool verbose)
 {
   int dir_fd = open (dir);
+  struct dirent entries[16];
+  int cnt;
+
   if (dir_fd == -1)
     {
       printf ("%s: not found\n", dir);
       return false;
     }
 
-  if (isdir (dir_fd))
+  cnt = getdents (dir_fd, entries, sizeof entries);
+  if (cnt >= 0)
     {
-      char name[READDIR_MAX_LEN];
-
       printf ("%s", dir);
       if (verbose)
         printf (" (inumber %d)", inumber (dir_fd));
       printf (":\n");
 
-      while (readdir (dir_fd, name))
+      /* Each call returns as many entries as fit in ENTRIES. */
+      for (; cnt > 0; cnt = getdents (dir_fd, entries, sizeof entries))
         {
-          printf ("%s", name);
-          if (verbose)
-            {
-              char full_name[128];
-              int entry_fd;
+          int i;
 
-              snprintf (full_name, sizeof full_name, "%s/%s", dir, name);
-              entry_fd = open (full_name);
+          for (i = 0; i < cnt; i++)
+            {
+              struct dirent *e = &entries[i];
 
-              printf (": ");
-              if (entry_fd != -1)
+              printf ("%s", e->d_name);
+              if (verbose)
                 {
-                  if (isdir (entry_fd))
+                  printf (": ");
+                  if (e->d_isdir)
                     printf ("directory");
                   else
-                    printf ("%d-byte file", filesize (entry_fd));
-                  printf (", inumber %d", inumber (entry_fd));
+                    {
+                      char full_name[128];
+                      int entry_fd;
+
+                      snprintf (full_name, sizeof full_name, "%s/%s",
+                                dir, e->d_name);
+                      entry_fd = open (full_name);
+                      if (entry_fd != -1)
+                        printf ("%d-byte file", filesize (entry_fd));
+                      else
+                        printf ("open failed");
+                      close (entry_fd);
+                    }
+                  printf (", inumber %d", e->d_ino);
                 }
-              else
-                printf ("open failed");
-              close (entry_fd);
+              printf ("\n");
             }
-          printf ("\n");
         }
     }
   else
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include <dirent.h>
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
@@ -26,7 +27,7 @@ struct dir_entry
 bool
 dir_create (block_sector_t sector, size_t entry_cnt)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  return inode_create_metadata (sector, entry_cnt * sizeof (struct dir_entry));
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -234,3 +235,62 @@ dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
     }
   return false;
 }
+
+/* Reads up to CNT of the following directory entries in DIR into
+   ENTRIES, reading a sector's worth of raw entries at a time
+   rather than one.  Returns the number of entries read, which is
+   less than CNT only if the directory contains no more
+   entries. */
+size_t
+dir_readdir_multiple (struct dir *dir, struct dirent *entries, size_t cnt)
+{
+  struct dir_entry batch[BLOCK_SECTOR_SIZE / sizeof (struct dir_entry)];
+  size_t n = 0;
+
+  ASSERT (dir != NULL);
+
+  while (n < cnt)
+    {
+      off_t bytes_read = inode_read_at (dir->inode, batch, sizeof batch,
+                                        dir->pos);
+      size_t i;
+
+      if (bytes_read < (off_t) sizeof *batch)
+        break;
+      for (i = 0; i < bytes_read / sizeof *batch && n < cnt; i++)
+        {
+          struct dir_entry *e = &batch[i];
+
+          dir->pos += sizeof *e;
+          if (e->in_use)
+            {
+              struct dirent *d = &entries[n++];
+              struct inode *inode = inode_open (e->inode_sector);
+
+              d->d_ino = e->inode_sector;
+              d->d_isdir = inode != NULL && inode_is_dir (inode);
+              strlcpy (d->d_name, e->name, sizeof d->d_name);
+              inode_close (inode);
+            }
+        }
+    }
+  return n;
+}
+
+/* Sets the current position in DIR to POS bytes from the start
+   of its entries. */
+void
+dir_seek (struct dir *dir, off_t pos)
+{
+  ASSERT (dir != NULL);
+  ASSERT (pos >= 0);
+  dir->pos = pos;
+}
+
+/* Returns the current position in DIR. */
+off_t
+dir_tell (struct dir *dir)
+{
+  ASSERT (dir != NULL);
+  return dir->pos;
+}
@@ -1,16 +1,25 @@
 #include "filesys/file.h"
 #include <debug.h>
 #include "filesys/inode.h"
+#include "filesys/tmpfs.h"
 #include "threads/malloc.h"
 
+/* Bytes moved at a time by file_copy(). */
+#define COPY_CHUNK (16 * BLOCK_SECTOR_SIZE)
+
 /* An open file. */
 struct file 
   {
-    struct inode *inode;        /* File's inode. */
+    struct inode *inode;        /* File's inode, if on disk. */
+    struct tmpfs_file *tmp;     /* File's tmpfs file, if in memory. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
   };
 
+static off_t read_at (struct file *, void *, off_t size, off_t offset);
+static off_t write_at (struct file *, const void *, off_t size,
+                       off_t offset);
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
@@ -33,11 +42,33 @@ file_open (struct inode *inode)
     }
 }
 
+/* Opens a file for the given tmpfs file TMP, of which it takes
+   ownership, and returns the new file.  Returns a null pointer
+   if an allocation fails or if TMP is null. */
+struct file *
+file_open_tmpfs (struct tmpfs_file *tmp) 
+{
+  struct file *file = calloc (1, sizeof *file);
+  if (tmp != NULL && file != NULL)
+    {
+      file->tmp = tmp;
+      return file;
+    }
+  else
+    {
+      tmpfs_close (tmp);
+      free (file);
+      return NULL; 
+    }
+}
+
 /* Opens and returns a new file for the same inode as FILE.
    Returns a null pointer if unsuccessful. */
 struct file *
 file_reopen (struct file *file) 
 {
+  if (file->tmp != NULL)
+    return file_open_tmpfs (tmpfs_reopen (file->tmp));
   return file_open (inode_reopen (file->inode));
 }
 
@@ -48,12 +79,24 @@ file_close (struct file *file)
   if (file != NULL)
     {
       file_allow_write (file);
-      inode_close (file->inode);
+      if (file->tmp != NULL)
+        tmpfs_close (file->tmp);
+      else
+        inode_close (file->inode);
       free (file); 
     }
 }
 
-/* Returns the inode encapsulated by FILE. */
+/* Returns true if FILE is kept in memory by the tmpfs, rather
+   than on disk. */
+bool
+file_in_memory (struct file *file) 
+{
+  return file->tmp != NULL;
+}
+
+/* Returns the inode encapsulated by FILE, or a null pointer if
+   FILE is in the tmpfs. */
 struct inode *
 file_get_inode (struct file *file) 
 {
@@ -68,7 +111,7 @@ file_get_inode (struct file *file)
 off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
-  off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  off_t bytes_read = read_at (file, buffer, size, file->pos);
   file->pos += bytes_read;
   return bytes_read;
 }
@@ -81,7 +124,7 @@ file_read (struct file *file, void *buffer, off_t size)
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) 
 {
-  return inode_read_at (file->inode, buffer, size, file_ofs);
+  return read_at (file, buffer, size, file_ofs);
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
@@ -94,7 +137,7 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs)
 off_t
 file_write (struct file *file, const void *buffer, off_t size) 
 {
-  off_t bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
+  off_t bytes_written = write_at (file, buffer, size, file->pos);
   file->pos += bytes_written;
   return bytes_written;
 }
@@ -110,7 +153,58 @@ off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
                off_t file_ofs) 
 {
-  return inode_write_at (file->inode, buffer, size, file_ofs);
+  return write_at (file, buffer, size, file_ofs);
+}
+
+/* Copies up to SIZE bytes from IN, starting at its current
+   position, to OUT, starting at its current position, without
+   passing through a caller's buffer.  Data moves in chunks of
+   COPY_CHUNK bytes, aligned to sector boundaries in IN, so that
+   whole runs of sectors are read and written with multi-sector
+   requests.
+   Returns the number of bytes copied, which may be less than
+   SIZE if end of file is reached in IN or OUT cannot be written,
+   or -1 if memory ran out.
+   Advances the positions of both files by the number of bytes
+   copied. */
+off_t
+file_copy (struct file *out, struct file *in, off_t size)
+{
+  uint8_t *buffer;
+  off_t bytes_copied = 0;
+
+  ASSERT (out != NULL && in != NULL);
+  ASSERT (size >= 0);
+
+  buffer = malloc (COPY_CHUNK);
+  if (buffer == NULL)
+    return -1;
+
+  while (size > 0)
+    {
+      /* Stop at the end of the chunk, or of the sector that ends
+         it if IN is not at a sector boundary. */
+      off_t chunk = COPY_CHUNK - in->pos % BLOCK_SECTOR_SIZE;
+      off_t bytes_read, bytes_written;
+
+      if (chunk > size)
+        chunk = size;
+      bytes_read = file_read (in, buffer, chunk);
+      if (bytes_read == 0)
+        break;
+      bytes_written = file_write (out, buffer, bytes_read);
+      bytes_copied += bytes_written;
+      size -= bytes_written;
+      if (bytes_written < bytes_read)
+        {
+          /* Leave IN just past what was actually copied. */
+          in->pos -= bytes_read - bytes_written;
+          break;
+        }
+    }
+  free (buffer);
+
+  return bytes_copied;
 }
 
 /* Prevents write operations on FILE's underlying inode
@@ -122,7 +216,10 @@ file_deny_write (struct file *file)
   if (!file->deny_write) 
     {
       file->deny_write = true;
-      inode_deny_write (file->inode);
+      if (file->tmp != NULL)
+        tmpfs_deny_write (file->tmp);
+      else
+        inode_deny_write (file->inode);
     }
 }
 
@@ -136,7 +233,10 @@ file_allow_write (struct file *file)
   if (file->deny_write) 
     {
       file->deny_write = false;
-      inode_allow_write (file->inode);
+      if (file->tmp != NULL)
+        tmpfs_allow_write (file->tmp);
+      else
+        inode_allow_write (file->inode);
     }
 }
 
@@ -145,6 +245,8 @@ off_t
 file_length (struct file *file) 
 {
   ASSERT (file != NULL);
+  if (file->tmp != NULL)
+    return tmpfs_length (file->tmp);
   return inode_length (file->inode);
 }
 
@@ -166,3 +268,35 @@ file_tell (struct file *file)
   ASSERT (file != NULL);
   return file->pos;
 }
+
+/* Makes all data written to FILE, and its metadata, durable.
+   Files in the tmpfs are never durable, so this does nothing for
+   them.
+   Returns true if successful, false if FILE's data could not be
+   written back. */
+bool
+file_sync (struct file *file) 
+{
+  ASSERT (file != NULL);
+  return file->tmp != NULL || inode_sync (file->inode);
+}
+
+/* Reads SIZE bytes from FILE's inode or tmpfs file into BUFFER,
+   starting at OFFSET. */
+static off_t
+read_at (struct file *file, void *buffer, off_t size, off_t offset) 
+{
+  if (file->tmp != NULL)
+    return tmpfs_read_at (file->tmp, buffer, size, offset);
+  return inode_read_at (file->inode, buffer, size, offset);
+}
+
+/* Writes SIZE bytes from BUFFER to FILE's inode or tmpfs file,
+   starting at OFFSET. */
+static off_t
+write_at (struct file *file, const void *buffer, off_t size, off_t offset) 
+{
+  if (file->tmp != NULL)
+    return tmpfs_write_at (file->tmp, buffer, size, offset);
+  return inode_write_at (file->inode, buffer, size, offset);
+}
@@ -6,6 +6,8 @@
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "filesys/journal.h"
+#include "filesys/tmpfs.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
@@ -22,7 +24,9 @@ filesys_init (bool format)
     PANIC ("No file system device found, can't initialize file system.");
 
   inode_init ();
+  tmpfs_init ();
   free_map_init ();
+  journal_init (format);
 
   if (format) 
     do_format ();
@@ -35,22 +39,32 @@ filesys_init (bool format)
 void
 filesys_done (void) 
 {
+  inode_flush_delayed ();
+  journal_flush ();
   free_map_close ();
 }
 
-/* Creates a file named NAME with the given INITIAL_SIZE.
+/* Creates a file named NAME with the given INITIAL_SIZE, in the
+   tmpfs if NAME begins with TMPFS_PREFIX.
    Returns true if successful, false otherwise.
    Fails if a file named NAME already exists,
    or if internal memory allocation fails. */
 bool
 filesys_create (const char *name, off_t initial_size) 
 {
+  const char *tmp_name = tmpfs_name (name);
   block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
+  struct dir *dir;
+  bool success;
+
+  if (tmp_name != NULL)
+    return tmpfs_create (tmp_name, initial_size);
+
+  dir = dir_open_root ();
+  success = (dir != NULL
+             && free_map_allocate (1, &inode_sector)
+             && inode_create (inode_sector, initial_size)
+             && dir_add (dir, name, inode_sector));
   if (!success && inode_sector != 0) 
     free_map_release (inode_sector, 1);
   dir_close (dir);
@@ -58,7 +72,12 @@ filesys_create (const char *name, off_t initial_size)
   return success;
 }
 
-/* Opens the file with the given NAME.
+/* Opens the file with the given NAME, in the tmpfs if NAME
+   begins with TMPFS_PREFIX.  "/" and "." name the root
+   directory itself, which may be read with getdents().  The
+   system calls refuse to write to it, but it is not opened with
+   writes denied, since that would also keep files from being
+   created in or removed from it while it is open.
    Returns the new file if successful or a null pointer
    otherwise.
    Fails if no file named NAME exists,
@@ -66,9 +85,17 @@ filesys_create (const char *name, off_t initial_size)
 struct file *
 filesys_open (const char *name)
 {
-  struct dir *dir = dir_open_root ();
+  const char *tmp_name = tmpfs_name (name);
+  struct dir *dir;
   struct inode *inode = NULL;
 
+  if (tmp_name != NULL)
+    return file_open_tmpfs (tmpfs_open (tmp_name));
+
+  if (!strcmp (name, "/") || !strcmp (name, "."))
+    return file_open (inode_open (ROOT_DIR_SECTOR));
+
+  dir = dir_open_root ();
   if (dir != NULL)
     dir_lookup (dir, name, &inode);
   dir_close (dir);
@@ -76,20 +103,39 @@ filesys_open (const char *name)
   return file_open (inode);
 }
 
-/* Deletes the file named NAME.
+/* Deletes the file named NAME, from the tmpfs if NAME begins
+   with TMPFS_PREFIX.
    Returns true if successful, false on failure.
    Fails if no file named NAME exists,
    or if an internal memory allocation fails. */
 bool
 filesys_remove (const char *name) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
+  const char *tmp_name = tmpfs_name (name);
+  struct dir *dir;
+  bool success;
+
+  if (tmp_name != NULL)
+    return tmpfs_remove (tmp_name);
+
+  dir = dir_open_root ();
+  success = dir != NULL && dir_remove (dir, name);
   dir_close (dir); 
 
   return success;
 }
 
+/* Writes all unwritten data and metadata to disk and makes it
+   durable. */
+void
+filesys_sync (void) 
+{
+  inode_flush_delayed ();
+  journal_flush ();
+  free_map_flush ();
+  block_flush (fs_device);
+}
+
 /* Formats the file system. */
 static void
 do_format (void)
@@ -98,6 +144,7 @@ do_format (void)
   free_map_create ();
   if (!dir_create (ROOT_DIR_SECTOR, 16))
     PANIC ("root directory creation failed");
+  journal_flush ();
   free_map_close ();
   printf ("done.\n");
 }
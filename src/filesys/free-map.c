@@ -1,79 +1,249 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* The free map is kept in memory and written back lazily: each
+   change marks the sectors of the free map file that it touches
+   as dirty, and only dirty sectors are written, by a background
+   thread every FLUSH_INTERVAL timer ticks, by free_map_flush(),
+   and when the free map is closed.
+
+   When the file system is journaled, released sectors are not
+   made available again until free_map_commit() is called, after
+   the transactions that released them have been committed, so
+   that a crash cannot leave a sector both in use on disk and
+   free. */
+
+/* Timer ticks between background flushes. */
+#define FLUSH_INTERVAL TIMER_FREQ
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static struct bitmap *dirty;         /* Dirty free map file sectors. */
+static struct bitmap *released;      /* Released, not yet committed. */
+static struct lock free_map_lock;    /* Protects all of the above. */
+
+static void release (block_sector_t sector, size_t cnt);
+static void mark_dirty (block_sector_t sector, size_t cnt);
+static void flush (void);
+static thread_func flusher;
 
 /* Initializes the free map. */
 void
-free_map_init (void) 
+free_map_init (void)
 {
   free_map = bitmap_create (block_size (fs_device));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
+  dirty = bitmap_create (DIV_ROUND_UP (bitmap_file_size (free_map),
+                                       BLOCK_SECTOR_SIZE));
+  released = bitmap_create (block_size (fs_device));
+  if (dirty == NULL || released == NULL)
+    PANIC ("dirty map creation failed");
+  lock_init (&free_map_lock);
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_set_multiple (free_map, JOURNAL_SECTOR, JOURNAL_SECTORS, true);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
    the first into *SECTORP.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   sectors were available. */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  block_sector_t sector;
+
+  lock_acquire (&free_map_lock);
+  sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+  if (sector != BITMAP_ERROR)
+    mark_dirty (sector, cnt);
+  lock_release (&free_map_lock);
+
+  if (sector != BITMAP_ERROR)
+    *sectorp = sector;
+  return sector != BITMAP_ERROR;
+}
+
+/* Allocates CNT consecutive sectors that all come before sector
+   LIMIT, choosing the first such run, and stores the first
+   sector into *SECTORP.
+   Returns true if successful, false if there is no such run. */
+bool
+free_map_allocate_before (size_t cnt, block_sector_t limit,
+                          block_sector_t *sectorp)
+{
+  size_t sector;
+
+  lock_acquire (&free_map_lock);
+  sector = bitmap_scan (free_map, 0, cnt, false);
+  if (sector != BITMAP_ERROR && sector + cnt <= limit)
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      bitmap_set_multiple (free_map, sector, cnt, true);
+      mark_dirty (sector, cnt);
     }
+  else
+    sector = BITMAP_ERROR;
+  lock_release (&free_map_lock);
+
   if (sector != BITMAP_ERROR)
     *sectorp = sector;
   return sector != BITMAP_ERROR;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Grows the run of OLD_CNT sectors starting at *SECTORP, which
+   were allocated earlier, to NEW_CNT consecutive sectors.  The
+   run is extended in place if the sectors just past it are free.
+   Otherwise, a new run is allocated and its first sector stored
+   into *SECTORP, and the old run is released; its contents are
+   not copied.  If OLD_CNT is 0, this is the same as
+   free_map_allocate().
+   Returns true if successful, false if not enough consecutive
+   sectors were available, in which case the old run is kept. */
+bool
+free_map_grow (block_sector_t *sectorp, size_t old_cnt, size_t new_cnt)
+{
+  block_sector_t old = *sectorp;
+  size_t sector;
+
+  ASSERT (new_cnt >= old_cnt);
+
+  lock_acquire (&free_map_lock);
+  if (old_cnt > 0 && old + new_cnt <= bitmap_size (free_map)
+      && bitmap_none (free_map, old + old_cnt, new_cnt - old_cnt))
+    {
+      bitmap_set_multiple (free_map, old + old_cnt, new_cnt - old_cnt, true);
+      mark_dirty (old + old_cnt, new_cnt - old_cnt);
+      sector = old;
+    }
+  else
+    {
+      sector = bitmap_scan_and_flip (free_map, 0, new_cnt, false);
+      if (sector != BITMAP_ERROR)
+        {
+          mark_dirty (sector, new_cnt);
+          if (old_cnt > 0)
+            release (old, old_cnt);
+        }
+    }
+  lock_release (&free_map_lock);
+
+  if (sector != BITMAP_ERROR)
+    *sectorp = sector;
+  return sector != BITMAP_ERROR;
+}
+
+/* Makes CNT sectors starting at SECTOR available for use, once
+   the current journal transactions have been committed. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
-  ASSERT (bitmap_all (free_map, sector, cnt));
-  bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  lock_acquire (&free_map_lock);
+  release (sector, cnt);
+  lock_release (&free_map_lock);
 }
 
-/* Opens the free map file and reads it from disk. */
+/* Makes the sectors released so far available for use.  Called
+   by the journal after committing the transactions that released
+   them. */
 void
-free_map_open (void) 
+free_map_commit (void)
+{
+  size_t start = 0;
+
+  lock_acquire (&free_map_lock);
+  while ((start = bitmap_scan (released, start, 1, true)) != BITMAP_ERROR)
+    {
+      size_t end = bitmap_scan (released, start, 1, false);
+      if (end == BITMAP_ERROR)
+        end = bitmap_size (released);
+      bitmap_set_multiple (free_map, start, end - start, false);
+      bitmap_set_multiple (released, start, end - start, false);
+      mark_dirty (start, end - start);
+      start = end;
+    }
+  lock_release (&free_map_lock);
+}
+
+/* Stores statistics about the free sectors in *STATS.  Released
+   sectors that are not yet committed are counted as in use. */
+void
+free_map_stats (struct free_map_stats *stats)
+{
+  size_t start = 0;
+
+  stats->free_cnt = stats->extent_cnt = stats->largest_extent = 0;
+
+  lock_acquire (&free_map_lock);
+  while ((start = bitmap_scan (free_map, start, 1, false)) != BITMAP_ERROR)
+    {
+      size_t end = bitmap_scan (free_map, start, 1, true);
+      if (end == BITMAP_ERROR)
+        end = bitmap_size (free_map);
+      stats->free_cnt += end - start;
+      stats->extent_cnt++;
+      if (end - start > stats->largest_extent)
+        stats->largest_extent = end - start;
+      start = end;
+    }
+  lock_release (&free_map_lock);
+}
+
+/* Writes every dirty sector of the free map to disk. */
+void
+free_map_flush (void)
+{
+  lock_acquire (&free_map_lock);
+  flush ();
+  lock_release (&free_map_lock);
+}
+
+/* Opens the free map file and reads it from disk, and starts the
+   thread that writes it back. */
+void
+free_map_open (void)
 {
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  bitmap_set_all (dirty, false);
+  if (thread_create ("free-map", PRI_DEFAULT, flusher, NULL) == TID_ERROR)
+    PANIC ("can't start free map flusher");
 }
 
 /* Writes the free map to disk and closes the free map file. */
 void
-free_map_close (void) 
+free_map_close (void)
 {
+  lock_acquire (&free_map_lock);
+  flush ();
   file_close (free_map_file);
+  free_map_file = NULL;
+  lock_release (&free_map_lock);
 }
 
 /* Creates a new free map file on disk and writes the free map to
    it. */
 void
-free_map_create (void) 
+free_map_create (void)
 {
-  /* Create inode. */
-  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+  /* Create inode.  Its size is rounded up to whole sectors so
+     that it never has its data inline, because writes to inline
+     data go through the journal, which itself flushes the free
+     map. */
+  if (!inode_create (FREE_MAP_SECTOR, ROUND_UP (bitmap_file_size (free_map),
+                                                BLOCK_SECTOR_SIZE)))
     PANIC ("free map creation failed");
 
   /* Write bitmap to file. */
@@ -82,4 +252,76 @@ free_map_create (void)
     PANIC ("can't open free map");
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
+  bitmap_set_all (dirty, false);
+}
+
+/* Releases CNT sectors starting at SECTOR, as described for
+   free_map_release().
+   The caller must hold free_map_lock. */
+static void
+release (block_sector_t sector, size_t cnt)
+{
+  ASSERT (lock_held_by_current_thread (&free_map_lock));
+  ASSERT (bitmap_all (free_map, sector, cnt));
+  ASSERT (bitmap_none (released, sector, cnt));
+  if (journal_enabled ())
+    bitmap_set_multiple (released, sector, cnt, true);
+  else
+    {
+      bitmap_set_multiple (free_map, sector, cnt, false);
+      mark_dirty (sector, cnt);
+    }
+}
+
+/* Marks the free map file sectors that hold the bits for CNT
+   sectors starting at SECTOR as dirty.
+   The caller must hold free_map_lock. */
+static void
+mark_dirty (block_sector_t sector, size_t cnt)
+{
+  size_t first, last;
+
+  ASSERT (lock_held_by_current_thread (&free_map_lock));
+  if (cnt == 0)
+    return;
+  first = sector / 8 / BLOCK_SECTOR_SIZE;
+  last = (sector + cnt - 1) / 8 / BLOCK_SECTOR_SIZE;
+  bitmap_set_multiple (dirty, first, last - first + 1, true);
+}
+
+/* Writes each run of dirty free map file sectors to disk and
+   marks them clean.  Does nothing if the free map file is not
+   open.
+   The caller must hold free_map_lock. */
+static void
+flush (void)
+{
+  size_t start = 0;
+
+  ASSERT (lock_held_by_current_thread (&free_map_lock));
+  if (free_map_file == NULL)
+    return;
+  while ((start = bitmap_scan (dirty, start, 1, true)) != BITMAP_ERROR)
+    {
+      size_t end = bitmap_scan (dirty, start, 1, false);
+      if (end == BITMAP_ERROR)
+        end = bitmap_size (dirty);
+      if (!bitmap_write_range (free_map, free_map_file,
+                               start * BLOCK_SECTOR_SIZE,
+                               (end - start) * BLOCK_SECTOR_SIZE))
+        PANIC ("can't write free map");
+      bitmap_set_multiple (dirty, start, end - start, false);
+      start = end;
+    }
+}
+
+/* Background thread that writes back the free map periodically. */
+static void
+flusher (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (FLUSH_INTERVAL);
+      free_map_flush ();
+    }
 }
@@ -5,13 +5,26 @@
 #include <stddef.h>
 #include "devices/block.h"
 
+/* Free space statistics. */
+struct free_map_stats
+  {
+    size_t free_cnt;            /* Free sectors. */
+    size_t extent_cnt;          /* Runs of consecutive free sectors. */
+    size_t largest_extent;      /* Sectors in the longest run. */
+  };
+
 void free_map_init (void);
 void free_map_read (void);
 void free_map_create (void);
 void free_map_open (void);
 void free_map_close (void);
+void free_map_flush (void);
 
 bool free_map_allocate (size_t, block_sector_t *);
+bool free_map_allocate_before (size_t, block_sector_t, block_sector_t *);
+bool free_map_grow (block_sector_t *, size_t, size_t);
 void free_map_release (block_sector_t, size_t);
+void free_map_commit (void);
+void free_map_stats (struct free_map_stats *);
 
 #endif /* filesys/free-map.h */
@@ -7,6 +7,8 @@
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "filesys/inode.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
@@ -67,6 +69,64 @@ fsutil_rm (char **argv)
     PANIC ("%s: delete failed\n", file_name);
 }
 
+/* Prints free space statistics STATS, labeled WHEN. */
+static void
+print_free_space (const char *when, const struct free_map_stats *stats)
+{
+  printf ("Free space %s: %zu sectors in %zu extents, "
+          "largest %zu sectors.\n",
+          when, stats->free_cnt, stats->extent_cnt, stats->largest_extent);
+}
+
+/* Compacts the file system by moving each file's data into the
+   first free run of sectors that holds it, if that comes before
+   where it is now.  Files are moved repeatedly until none can
+   move, so that free space collects into long runs at the end of
+   the disk and later files can be allocated in one piece.
+   Prints free space statistics before and after. */
+void
+fsutil_defrag (char **argv UNUSED) 
+{
+  struct free_map_stats stats;
+  size_t moved = 0;
+  bool progress;
+
+  printf ("Defragmenting file system...\n");
+  free_map_stats (&stats);
+  print_free_space ("before", &stats);
+
+  do
+    {
+      struct dir *dir = dir_open_root ();
+      char name[NAME_MAX + 1];
+
+      if (dir == NULL)
+        PANIC ("root dir open failed");
+      progress = false;
+      while (dir_readdir (dir, name))
+        {
+          struct inode *inode;
+
+          if (dir_lookup (dir, name, &inode) && inode_relocate (inode))
+            {
+              moved++;
+              progress = true;
+            }
+          inode_close (inode);
+        }
+      dir_close (dir);
+
+      /* Commit the moves, so that the sectors they released can
+         be used by the next pass. */
+      filesys_sync ();
+    }
+  while (progress);
+
+  free_map_stats (&stats);
+  print_free_space ("after", &stats);
+  printf ("Moved %zu files.\n", moved);
+}
+
 /* Extracts a ustar-format tar archive from the scratch block
    device into the Pintos file system. */
 void
@@ -1,23 +1,61 @@
 #include "filesys/inode.h"
-#include <list.h>
+#include <hash.h>
 #include <debug.h>
 #include <round.h>
 #include <string.h>
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Most bytes of file data held in memory by a delayed inode. */
+#define DELAYED_MAX (64 * BLOCK_SECTOR_SIZE)
+
+/* Sectors copied at a time by inode_relocate(). */
+#define RELOCATE_CHUNK 16
+
+/* Sectors of zeros written at a time by zero_fill(). */
+#define ZERO_CHUNK 16
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Inode flags. */
+#define INODE_INLINE 0x1                /* Data is stored in the inode. */
+#define INODE_LAZY 0x2                  /* INITIALIZED is valid. */
+#define INODE_META 0x4                  /* Data is journaled metadata. */
+
+/* Bytes of file data that fit in the inode sector itself: the
+   sector less the five 32-bit members of struct inode_disk that
+   come before INLINE_DATA, which is 492 bytes. */
+#define INODE_INLINE_MAX (BLOCK_SECTOR_SIZE - 5 * sizeof (uint32_t))
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+   A file no longer than INODE_INLINE_MAX bytes keeps its data in
+   INLINE_DATA and has INODE_INLINE set in FLAGS, so reading it
+   takes only the inode sector.  Otherwise its data occupies
+   contiguous sectors beginning at START.
+
+   Data sectors are not zeroed when they are allocated.  Instead,
+   if INODE_LAZY is set, only the first INITIALIZED data sectors
+   have ever been written, and the rest read as zeros without
+   touching the disk.
+
+   Inode sectors are always written through the journal.  Data
+   sectors are too if INODE_META is set, as it is for
+   directories.  Inodes written before FLAGS existed have it
+   zeroed, so they read back correctly. */
 struct inode_disk
   {
     block_sector_t start;               /* First data sector. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    uint32_t flags;                     /* INODE_* flags. */
+    uint32_t initialized;               /* Data sectors written so far. */
+    uint8_t inline_data[INODE_INLINE_MAX]; /* Data of an inline file. */
   };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -28,17 +66,147 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
-/* In-memory inode. */
+/* In-memory inode.
+
+   When an inline file grows past INODE_INLINE_MAX bytes, its data
+   sectors are not allocated right away.  Instead its data moves
+   to DELAYED, a buffer in memory, and further writes go there,
+   until the data is written back: when the last opener closes
+   the inode, when it is synced, when the file system is synced
+   or shut down, or when the file would outgrow DELAYED_MAX.
+   Only then are data sectors allocated, all at once for the
+   whole file, so a file grown by many small writes still gets
+   one contiguous run of sectors, even while other files grow
+   too, and the free map is updated once rather than on every
+   write.  Until then, the inode on disk still holds the inline
+   data as of the last write-back.
+
+   So that write-back cannot fail for lack of space, a run of
+   sectors big enough for the data is reserved in the free map as
+   the buffer grows, and a write that the disk has no room for
+   fails right away.  The run is only a reservation: the inode
+   does not point to it, and nothing is written to it, until
+   write-back.  So it may still be moved elsewhere, at no cost,
+   when it cannot grow in place. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem elem;              /* Element in open_inodes. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
     struct inode_disk data;             /* Inode content. */
+    uint8_t *delayed;                   /* Data not yet allocated, or null. */
+    size_t delayed_size;                /* Bytes allocated for DELAYED. */
+    block_sector_t reserved_start;      /* First sector of reservation. */
+    size_t reserved_cnt;                /* Sectors reserved for DELAYED. */
   };
 
+/* Returns true if INODE's data is stored inline. */
+static inline bool
+is_inline (const struct inode *inode)
+{
+  return (inode->data.flags & INODE_INLINE) != 0;
+}
+
+/* Returns true if INODE's data sectors are journaled. */
+static inline bool
+is_metadata (const struct inode *inode)
+{
+  return (inode->data.flags & INODE_META) != 0;
+}
+
+/* Reads data sector SECTOR of INODE into BUFFER. */
+static void
+read_data (const struct inode *inode, block_sector_t sector, void *buffer)
+{
+  if (is_metadata (inode))
+    journal_read (sector, buffer);
+  else
+    block_read (fs_device, sector, buffer);
+}
+
+/* Writes BUFFER to data sector SECTOR of INODE.  For a metadata
+   inode, the caller must be within a journal transaction. */
+static void
+write_data (const struct inode *inode, block_sector_t sector,
+            const void *buffer)
+{
+  if (is_metadata (inode))
+    journal_write (sector, buffer);
+  else
+    block_write (fs_device, sector, buffer);
+}
+
+/* Writes INODE's on-disk inode back to disk.
+   The caller must be within a journal transaction. */
+static void
+write_inode (struct inode *inode)
+{
+  journal_write (inode->sector, &inode->data);
+}
+
+/* Returns the number of data sectors of INODE, counting from
+   the first, whose contents are on disk.  Sectors past these
+   have never been written and read as zeros. */
+static size_t
+initialized_sectors (const struct inode *inode)
+{
+  if (inode->data.flags & INODE_LAZY)
+    return inode->data.initialized;
+  else
+    return bytes_to_sectors (inode->data.length);
+}
+
+/* Writes zeros to data sectors of INODE from its first
+   uninitialized sector up to but not including data sector
+   SECTOR_IDX, so that data sectors before SECTOR_IDX are all
+   initialized.  Needed before writing into the middle of a file
+   beyond what has been initialized.  Ordinary data goes out in
+   runs of up to ZERO_CHUNK sectors; journaled data must still be
+   logged a sector at a time. */
+static void
+zero_fill (struct inode *inode, size_t sector_idx)
+{
+  static char zeros[ZERO_CHUNK * BLOCK_SECTOR_SIZE];
+
+  while (inode->data.initialized < sector_idx)
+    {
+      size_t cnt = sector_idx - inode->data.initialized;
+      block_sector_t sector = inode->data.start + inode->data.initialized;
+
+      if (is_metadata (inode))
+        {
+          write_data (inode, sector, zeros);
+          cnt = 1;
+        }
+      else
+        {
+          if (cnt > ZERO_CHUNK)
+            cnt = ZERO_CHUNK;
+          block_write_multiple (fs_device, sector, cnt, zeros);
+        }
+      inode->data.initialized += cnt;
+    }
+}
+
+/* Records that data sectors of INODE before SECTOR_IDX are
+   initialized, if not already.  Returns true if so, in which
+   case the caller must write the inode back to disk after the
+   data itself, so that the inode never claims sectors that hold
+   stale data. */
+static bool
+mark_initialized (struct inode *inode, size_t sector_idx)
+{
+  if ((inode->data.flags & INODE_LAZY)
+      && inode->data.initialized < sector_idx)
+    {
+      inode->data.initialized = sector_idx;
+      return true;
+    }
+  return false;
+}
+
 /* Returns the block device sector that contains byte offset POS
    within INODE.
    Returns -1 if INODE does not contain data for a byte at offset
@@ -47,30 +215,95 @@ static block_sector_t
 byte_to_sector (const struct inode *inode, off_t pos) 
 {
   ASSERT (inode != NULL);
+  ASSERT (!is_inline (inode));
   if (pos < inode->data.length)
     return inode->data.start + pos / BLOCK_SECTOR_SIZE;
   else
     return -1;
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Open inodes, keyed by sector, so that opening a single inode
+   twice returns the same `struct inode'.  open_inodes_lock
+   protects the table and the open_cnt of every inode in it, but
+   is not held while reading an inode from disk, so opens of
+   different inodes can proceed at the same time. */
+static struct hash open_inodes;
+static struct lock open_inodes_lock;
+
+static hash_hash_func inode_hash;
+static hash_less_func inode_less;
+static bool create (block_sector_t, off_t, uint32_t flags);
+static bool flush_delayed (struct inode *);
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  hash_init (&open_inodes, inode_hash, inode_less, NULL);
+  lock_init (&open_inodes_lock);
+}
+
+/* Returns a hash value for inode E. */
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct inode, elem)->sector);
+}
+
+/* Returns true if inode A precedes inode B. */
+static bool
+inode_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct inode *a = hash_entry (a_, struct inode, elem);
+  const struct inode *b = hash_entry (b_, struct inode, elem);
+  return a->sector < b->sector;
+}
+
+/* Returns the open inode for SECTOR, or a null pointer if it is
+   not open.
+   The caller must hold open_inodes_lock. */
+static struct inode *
+find_open_inode (block_sector_t sector)
+{
+  /* Only the key is examined, and the lock serializes use of
+     this, so it needn't live on the (small) stack. */
+  static struct inode key;
+  struct hash_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&open_inodes_lock));
+  key.sector = sector;
+  e = hash_find (&open_inodes, &key.elem);
+  return e != NULL ? hash_entry (e, struct inode, elem) : NULL;
 }
 
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
-   device.
+   device.  If LENGTH is small enough, the data is kept inline
+   and no data sectors are allocated.  Otherwise data sectors are
+   allocated but not written: they read as zeros until they are
+   first written.
    Returns true if successful.
    Returns false if memory or disk allocation fails. */
 bool
 inode_create (block_sector_t sector, off_t length)
+{
+  return create (sector, length, 0);
+}
+
+/* Like inode_create(), but for a file that holds file system
+   metadata, such as a directory, whose data is updated through
+   the journal. */
+bool
+inode_create_metadata (block_sector_t sector, off_t length)
+{
+  return create (sector, length, INODE_META);
+}
+
+/* Creates an inode as described for inode_create(), with the
+   given initial FLAGS. */
+static bool
+create (block_sector_t sector, off_t length, uint32_t flags)
 {
   struct inode_disk *disk_inode = NULL;
   bool success = false;
@@ -87,19 +320,23 @@ inode_create (block_sector_t sector, off_t length)
       size_t sectors = bytes_to_sectors (length);
       disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
+      if (length <= (off_t) INODE_INLINE_MAX)
         {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
+          disk_inode->flags = flags | INODE_INLINE;
+          success = true;
+        }
+      else if (free_map_allocate (sectors, &disk_inode->start)) 
+        {
+          disk_inode->flags = flags | INODE_LAZY;
+          disk_inode->initialized = 0;
           success = true; 
         } 
+      if (success)
+        {
+          journal_begin ();
+          journal_write (sector, disk_inode);
+          journal_end ();
+        }
       free (disk_inode);
     }
   return success;
@@ -111,20 +348,16 @@ inode_create (block_sector_t sector, off_t length)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
-  struct inode *inode;
+  struct inode *inode, *open;
 
   /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
-    {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
-    }
+  lock_acquire (&open_inodes_lock);
+  open = find_open_inode (sector);
+  if (open != NULL)
+    open->open_cnt++;
+  lock_release (&open_inodes_lock);
+  if (open != NULL)
+    return open;
 
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
@@ -132,12 +365,30 @@ inode_open (block_sector_t sector)
     return NULL;
 
   /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  inode->delayed = NULL;
+  inode->delayed_size = 0;
+  inode->reserved_start = 0;
+  inode->reserved_cnt = 0;
+  journal_read (inode->sector, &inode->data);
+
+  /* Another thread may have opened the same inode while we were
+     reading it.  If so, use that one instead. */
+  lock_acquire (&open_inodes_lock);
+  open = find_open_inode (sector);
+  if (open != NULL)
+    open->open_cnt++;
+  else
+    hash_insert (&open_inodes, &inode->elem);
+  lock_release (&open_inodes_lock);
+  if (open != NULL)
+    {
+      free (inode);
+      return open;
+    }
   return inode;
 }
 
@@ -146,7 +397,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -163,24 +418,50 @@ inode_get_inumber (const struct inode *inode)
 void
 inode_close (struct inode *inode) 
 {
+  bool last;
+
   /* Ignore null pointer. */
   if (inode == NULL)
     return;
 
+  /* If this is the last opener, write back any delayed data
+     first, while the inode is still in the open inode table, so
+     that anyone who opens it meanwhile finds it there instead of
+     reading a stale copy from disk.  They may also write more
+     delayed data before closing it again, so check again.
+     Write-back cannot fail, because the sectors for the data
+     were reserved as it was written. */
+  lock_acquire (&open_inodes_lock);
+  while (inode->open_cnt == 1 && !inode->removed && inode->delayed != NULL)
+    {
+      lock_release (&open_inodes_lock);
+      flush_delayed (inode);
+      lock_acquire (&open_inodes_lock);
+    }
+
+  /* Remove from the open inode table if this was the last
+     opener. */
+  last = --inode->open_cnt == 0;
+  if (last)
+    hash_delete (&open_inodes, &inode->elem);
+  lock_release (&open_inodes_lock);
+
   /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  if (last)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
-      /* Deallocate blocks if removed. */
+      /* Deallocate blocks if removed, along with any sectors
+         reserved for delayed data. */
       if (inode->removed) 
         {
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          if (!is_inline (inode))
+            free_map_release (inode->data.start,
+                              bytes_to_sectors (inode->data.length)); 
+          if (inode->reserved_cnt > 0)
+            free_map_release (inode->reserved_start, inode->reserved_cnt);
         }
 
+      free (inode->delayed);
       free (inode); 
     }
 }
@@ -204,12 +485,32 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
   off_t bytes_read = 0;
   uint8_t *bounce = NULL;
 
+  if (is_inline (inode))
+    {
+      /* The data is already in memory, in the inode or in its
+         delayed buffer. */
+      const uint8_t *data = (inode->delayed != NULL ? inode->delayed
+                             : inode->data.inline_data);
+      off_t inode_left = inode_length (inode) - offset;
+      if (inode_left <= 0)
+        return 0;
+      if (size > inode_left)
+        size = inode_left;
+      memcpy (buffer, data + offset, size);
+      return size;
+    }
+
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
       block_sector_t sector_idx = byte_to_sector (inode, offset);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
+      /* Data sectors from here that are on disk. */
+      size_t file_sector = offset / BLOCK_SECTOR_SIZE;
+      size_t init_cnt = initialized_sectors (inode);
+      size_t init_left = init_cnt > file_sector ? init_cnt - file_sector : 0;
+
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
       off_t inode_left = inode_length (inode) - offset;
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
@@ -220,10 +521,22 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE
+          && !is_metadata (inode))
         {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
+          /* Read the run of full sectors starting here directly
+             into caller's buffer.  File data is contiguous on
+             disk, so a single request covers the whole run.
+             Sectors never written are zeros. */
+          off_t run = size < inode_left ? size : inode_left;
+          size_t sector_cnt = run / BLOCK_SECTOR_SIZE;
+          size_t disk_cnt = init_left < sector_cnt ? init_left : sector_cnt;
+          if (disk_cnt > 0)
+            block_read_multiple (fs_device, sector_idx, disk_cnt,
+                                 buffer + bytes_read);
+          memset (buffer + bytes_read + disk_cnt * BLOCK_SECTOR_SIZE, 0,
+                  (sector_cnt - disk_cnt) * BLOCK_SECTOR_SIZE);
+          chunk_size = sector_cnt * BLOCK_SECTOR_SIZE;
         }
       else 
         {
@@ -235,7 +548,10 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
               if (bounce == NULL)
                 break;
             }
-          block_read (fs_device, sector_idx, bounce);
+          if (init_left > 0)
+            read_data (inode, sector_idx, bounce);
+          else
+            memset (bounce, 0, BLOCK_SECTOR_SIZE);
           memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
         }
       
@@ -249,11 +565,212 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
   return bytes_read;
 }
 
+/* Grows the run of sectors reserved for INODE's delayed data to
+   CNT sectors, if it is smaller.
+   Returns true if successful, false if there is no room, in
+   which case the reservation is unchanged. */
+static bool
+reserve (struct inode *inode, size_t cnt)
+{
+  if (cnt <= inode->reserved_cnt)
+    return true;
+  if (!free_map_grow (&inode->reserved_start, inode->reserved_cnt, cnt))
+    return false;
+  inode->reserved_cnt = cnt;
+  return true;
+}
+
+/* Moves the inline or delayed data of INODE out to the data
+   sectors reserved for it, or newly allocated ones, at the same
+   time extending it to LENGTH bytes if that is longer.  The
+   bytes added are zeros.
+   Returns true if successful, false if disk allocation fails,
+   in which case INODE is unchanged.
+   The caller must be within a journal transaction. */
+static bool
+inode_migrate (struct inode *inode, off_t length)
+{
+  struct inode_disk *disk_inode = &inode->data;
+  size_t sectors, data_sectors;
+  block_sector_t start;
+  uint8_t *bounce = NULL;
+
+  ASSERT (is_inline (inode));
+
+  if (length < disk_inode->length)
+    length = disk_inode->length;
+  sectors = bytes_to_sectors (length);
+  if (inode->delayed == NULL)
+    {
+      bounce = calloc (1, BLOCK_SECTOR_SIZE);
+      if (bounce == NULL)
+        return false;
+    }
+  if (!reserve (inode, sectors))
+    {
+      free (bounce);
+      return false;
+    }
+
+  /* Take over the reserved sectors, giving back those the data
+     does not need. */
+  start = inode->reserved_start;
+  if (inode->reserved_cnt > sectors)
+    free_map_release (start + sectors, inode->reserved_cnt - sectors);
+  inode->reserved_start = 0;
+  inode->reserved_cnt = 0;
+
+  /* Write out the data before pointing the inode at it.  The
+     sectors after those that hold data are left
+     uninitialized.  A delayed buffer is a whole number of
+     sectors long and zeroed past the end of the data, so it is
+     written as is, in one request. */
+  if (inode->delayed != NULL)
+    {
+      data_sectors = bytes_to_sectors (disk_inode->length);
+      ASSERT (data_sectors * BLOCK_SECTOR_SIZE <= inode->delayed_size);
+      block_write_multiple (fs_device, start, data_sectors, inode->delayed);
+      free (inode->delayed);
+      inode->delayed = NULL;
+      inode->delayed_size = 0;
+    }
+  else
+    {
+      data_sectors = 1;
+      memcpy (bounce, disk_inode->inline_data, disk_inode->length);
+      write_data (inode, start, bounce);
+      free (bounce);
+    }
+
+  disk_inode->start = start;
+  disk_inode->length = length;
+  disk_inode->flags = (disk_inode->flags & ~INODE_INLINE) | INODE_LAZY;
+  disk_inode->initialized = data_sectors;
+  memset (disk_inode->inline_data, 0, sizeof disk_inode->inline_data);
+  write_inode (inode);
+  return true;
+}
+
+/* Writes back the delayed data of INODE to the sectors reserved
+   for it, in a transaction of its own.
+   Returns true if successful, false if disk allocation fails,
+   which can happen only if INODE has been extended past what
+   was reserved. */
+static bool
+flush_delayed (struct inode *inode)
+{
+  bool success;
+
+  journal_begin ();
+  success = inode_migrate (inode, inode->data.length);
+  journal_end ();
+  return success;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET,
+   for an inline inode that has grown, or is growing, past
+   INODE_INLINE_MAX bytes.  The data is kept in the inode's
+   delayed buffer, without allocating any data sectors yet.
+   Returns the number of bytes actually written, or -1 if the
+   data has been moved out to data sectors instead, because it
+   no longer fits in DELAYED_MAX bytes, memory ran out, or no run
+   of sectors could be reserved for it, and the caller should
+   write it to disk.  Returns 0 if that fails too. */
+static off_t
+inode_write_delayed (struct inode *inode, const uint8_t *buffer, off_t size,
+                     off_t offset)
+{
+  struct inode_disk *disk_inode = &inode->data;
+  off_t end = offset + size;
+  size_t sectors;
+  bool migrated;
+
+  if (end > DELAYED_MAX)
+    goto flush;
+
+  /* Reserve sectors for the data, so that it can be written back
+     later, with room to spare so that the reservation need not
+     grow on every write.  If the disk is too full even for the
+     data itself, try to write it out now instead, which fails
+     the write if there is no room. */
+  sectors = bytes_to_sectors (end > disk_inode->length
+                              ? end : disk_inode->length);
+  if (!reserve (inode, (sectors * 2 < DELAYED_MAX / BLOCK_SECTOR_SIZE
+                        ? sectors * 2 : DELAYED_MAX / BLOCK_SECTOR_SIZE))
+      && !reserve (inode, sectors))
+    goto flush;
+
+  if ((size_t) end > inode->delayed_size)
+    {
+      /* Grow the buffer geometrically, in whole sectors, keeping
+         the bytes past the end of the data zeroed. */
+      size_t new_size = ROUND_UP (end, BLOCK_SECTOR_SIZE) * 2;
+      uint8_t *delayed;
+
+      if (new_size > DELAYED_MAX)
+        new_size = DELAYED_MAX;
+      delayed = realloc (inode->delayed, new_size);
+      if (delayed == NULL)
+        goto flush;
+      if (inode->delayed == NULL)
+        memcpy (delayed, disk_inode->inline_data, disk_inode->length);
+      memset (delayed + disk_inode->length, 0,
+              new_size - disk_inode->length);
+      inode->delayed = delayed;
+      inode->delayed_size = new_size;
+    }
+
+  memcpy (inode->delayed + offset, buffer, size);
+  if (end > disk_inode->length)
+    disk_inode->length = end;
+  return size;
+
+ flush:
+  /* Allocate for the whole write at once. */
+  journal_begin ();
+  migrated = inode_migrate (inode, end);
+  journal_end ();
+  return migrated ? -1 : 0;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET,
+   for an inode whose data is inline.  Writing past end of file
+   extends the inode, moving its data out to data sectors if it
+   no longer fits inline.
+   Returns the number of bytes actually written, or -1 if the
+   data has been moved out of the inode and the caller should
+   write it to disk instead. */
+static off_t
+inode_write_inline (struct inode *inode, const uint8_t *buffer, off_t size,
+                    off_t offset)
+{
+  struct inode_disk *disk_inode = &inode->data;
+  off_t end = offset + size;
+
+  if (end > (off_t) INODE_INLINE_MAX)
+    return inode_migrate (inode, end) ? -1 : 0;
+
+  /* Bytes between the old end of file and OFFSET read as
+     zeros. */
+  if (offset > disk_inode->length)
+    memset (disk_inode->inline_data + disk_inode->length, 0,
+            offset - disk_inode->length);
+  memcpy (disk_inode->inline_data + offset, buffer, size);
+  if (end > disk_inode->length)
+    disk_inode->length = end;
+  write_inode (inode);
+  return size;
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
    less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   Inodes whose data is inline, or delayed, grow on demand.
+   (Normally a write at end of file would extend any inode, but
+   growth of inodes with data sectors is not yet implemented.)
+
+   A write that updates metadata is a single journal
+   transaction, so it is applied completely or not at all. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
@@ -261,15 +778,43 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
   uint8_t *bounce = NULL;
+  bool journaled, inode_dirty = false;
 
-  if (inode->deny_write_cnt)
+  if (inode->deny_write_cnt || size <= 0)
     return 0;
 
+  /* Defer allocation for ordinary inline data that outgrows the
+     inode. */
+  if (is_inline (inode) && !is_metadata (inode)
+      && (inode->delayed != NULL || offset + size > (off_t) INODE_INLINE_MAX))
+    {
+      off_t written = inode_write_delayed (inode, buffer, size, offset);
+      if (written >= 0)
+        return written;
+    }
+
+  /* Ordinary data is written in place, and only the inode, if it
+     changes at all, is journaled. */
+  journaled = is_metadata (inode) || is_inline (inode);
+  if (journaled)
+    journal_begin ();
+
+  if (is_inline (inode))
+    {
+      off_t written = inode_write_inline (inode, buffer, size, offset);
+      if (written >= 0)
+        {
+          journal_end ();
+          return written;
+        }
+    }
+
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
       block_sector_t sector_idx = byte_to_sector (inode, offset);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+      size_t file_sector = offset / BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
       off_t inode_left = inode_length (inode) - offset;
@@ -281,10 +826,21 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      /* Keep the initialized sectors contiguous. */
+      if (inode->data.flags & INODE_LAZY)
+        zero_fill (inode, file_sector);
+
+      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE
+          && !is_metadata (inode))
         {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
+          /* Write the run of full sectors starting here directly
+             to disk, as a single request. */
+          off_t run = size < inode_left ? size : inode_left;
+          size_t sector_cnt = run / BLOCK_SECTOR_SIZE;
+          block_write_multiple (fs_device, sector_idx, sector_cnt,
+                                buffer + bytes_written);
+          chunk_size = sector_cnt * BLOCK_SECTOR_SIZE;
+          inode_dirty |= mark_initialized (inode, file_sector + sector_cnt);
         }
       else 
         {
@@ -298,13 +854,16 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 
           /* If the sector contains data before or after the chunk
              we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
+             first.  Otherwise, or if the sector has never been
+             written, we start with a sector of all zeros. */
+          if ((sector_ofs > 0 || chunk_size < sector_left)
+              && file_sector < initialized_sectors (inode)) 
+            read_data (inode, sector_idx, bounce);
           else
             memset (bounce, 0, BLOCK_SECTOR_SIZE);
           memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
+          write_data (inode, sector_idx, bounce);
+          inode_dirty |= mark_initialized (inode, file_sector + 1);
         }
 
       /* Advance. */
@@ -314,6 +873,17 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
     }
   free (bounce);
 
+  if (inode_dirty)
+    {
+      if (!journaled)
+        journal_begin ();
+      write_inode (inode);
+      if (!journaled)
+        journal_end ();
+    }
+  if (journaled)
+    journal_end ();
+
   return bytes_written;
 }
 
@@ -343,3 +913,124 @@ inode_length (const struct inode *inode)
 {
   return inode->data.length;
 }
+
+/* Returns true if INODE holds a directory.  Directories are the
+   only files whose data is journaled. */
+bool
+inode_is_dir (const struct inode *inode)
+{
+  return is_metadata (inode);
+}
+
+/* Moves INODE's data sectors to the first run of free sectors
+   that holds them, if that run comes before where they are now,
+   so that free space collects at the end of the disk.  Only the
+   sectors that have been written are copied.  The inode is then
+   pointed at the new sectors in a single journal transaction,
+   and the old sectors are released, so they are not reused until
+   the new location has been committed; a crash at any point
+   leaves the file readable at one location or the other.
+   Inline and metadata inodes are never moved.
+   Returns true if INODE was moved, false otherwise.
+   The caller must make sure that nothing else reads or writes
+   INODE's data at the same time. */
+bool
+inode_relocate (struct inode *inode)
+{
+  struct inode_disk *disk_inode = &inode->data;
+  size_t sectors, init_cnt, i;
+  block_sector_t old_start, new_start;
+  uint8_t *buffer;
+
+  if (is_inline (inode) || is_metadata (inode) || disk_inode->length == 0)
+    return false;
+  sectors = bytes_to_sectors (disk_inode->length);
+  old_start = disk_inode->start;
+
+  buffer = malloc (RELOCATE_CHUNK * BLOCK_SECTOR_SIZE);
+  if (buffer == NULL)
+    return false;
+  if (!free_map_allocate_before (sectors, old_start, &new_start))
+    {
+      free (buffer);
+      return false;
+    }
+
+  /* Copy the data before pointing the inode at it. */
+  init_cnt = initialized_sectors (inode);
+  for (i = 0; i < init_cnt; i += RELOCATE_CHUNK)
+    {
+      size_t cnt = init_cnt - i < RELOCATE_CHUNK ? init_cnt - i
+                                                 : RELOCATE_CHUNK;
+      block_read_multiple (fs_device, old_start + i, cnt, buffer);
+      block_write_multiple (fs_device, new_start + i, cnt, buffer);
+    }
+  free (buffer);
+
+  journal_begin ();
+  disk_inode->start = new_start;
+  write_inode (inode);
+  journal_end ();
+  free_map_release (old_start, sectors);
+  return true;
+}
+
+/* Writes back the delayed data of every open inode.
+
+   open_inodes_lock is not held during the I/O, so that opens and
+   closes of other inodes need not wait for it.  Instead, inodes
+   are taken in order of sector number, holding a reference to
+   each while it is written back, and the table is searched again
+   for the next one afterward, since it may have changed. */
+void
+inode_flush_delayed (void)
+{
+  struct inode *inode;
+  block_sector_t next = 0;
+
+  for (;;)
+    {
+      struct hash_iterator i;
+
+      /* Find the delayed inode with the lowest sector number
+         at or after NEXT, and take a reference to it. */
+      inode = NULL;
+      lock_acquire (&open_inodes_lock);
+      hash_first (&i, &open_inodes);
+      while (hash_next (&i))
+        {
+          struct inode *cur = hash_entry (hash_cur (&i), struct inode, elem);
+          if (cur->delayed != NULL && cur->sector >= next
+              && (inode == NULL || cur->sector < inode->sector))
+            inode = cur;
+        }
+      if (inode != NULL)
+        inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+      if (inode == NULL)
+        break;
+
+      flush_delayed (inode);
+      next = inode->sector + 1;
+      inode_close (inode);
+    }
+}
+
+/* Makes the data and metadata of INODE durable.  Delayed data is
+   written back first.  Other data is written to the device as
+   soon as it is written to the inode, so only the metadata needs
+   to be committed, which commits the metadata of other inodes
+   along with it.  Then the device's write cache is flushed.
+   Returns true if successful, false if the delayed data could
+   not be written back. */
+bool
+inode_sync (struct inode *inode)
+{
+  bool success = true;
+
+  if (inode->delayed != NULL)
+    success = flush_delayed (inode);
+  journal_flush ();
+  block_flush (fs_device);
+  return success;
+}
@@ -0,0 +1,333 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Write-ahead journal for file system metadata.
+
+   Metadata sectors (inodes and directory data) are not written
+   in place when they change.  Instead, journal_write() keeps the
+   new contents of each sector in memory, in the running batch.
+   Every so often the whole batch is committed: the sector images
+   are written to the journal area in one sequential request,
+   then the journal header naming them is written, and only then
+   are the images written to their home locations.  Once that is
+   done the header is cleared.  If the system crashes after the
+   header is written, journal_init() replays the images at the
+   next boot, so a batch is applied either completely or not at
+   all.
+
+   Updates are grouped into transactions with journal_begin()
+   and journal_end(), and a batch is only committed when no
+   transaction is in progress, so each transaction is atomic.
+   Many transactions are committed together: by a background
+   thread every COMMIT_INTERVAL timer ticks, by journal_flush(),
+   and whenever the batch is about to fill up.
+
+   The free map is not journaled.  Instead, the free map is
+   written back as part of each commit, before the batch, so
+   that it records every allocation the batch refers to, and
+   sectors released by a transaction are only returned to the
+   free map after the transaction has been committed.  A crash
+   can therefore leak sectors, but never leaves an allocated
+   sector marked free. */
+
+/* Identifies a journal header. */
+#define JOURNAL_MAGIC 0x4a524e4c
+
+/* Timer ticks between background commits. */
+#define COMMIT_INTERVAL TIMER_FREQ
+
+/* On-disk journal header.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct journal_header
+  {
+    unsigned magic;                     /* Magic number. */
+    uint32_t cnt;                       /* Number of images, 0 if none. */
+    block_sector_t sectors[JOURNAL_RECORDS]; /* Home of each image. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 8 - 4 * JOURNAL_RECORDS];
+  };
+
+static bool enabled;                    /* False if the disk has no journal. */
+static struct journal_header *header;   /* Header of running batch. */
+static uint8_t *images;                 /* Sector images of running batch. */
+static struct block_request *requests;  /* For writing images home. */
+
+/* Protects the following, and the running batch. */
+static struct lock journal_lock;
+static struct condition changed;        /* ACTIVE or COMMITTING changed. */
+static int active;                      /* Transactions in progress. */
+static bool committing;                 /* True while a commit runs. */
+static struct thread *committer;        /* Thread doing the commit. */
+
+static void commit (void);
+static void write_home (void);
+static int find_record (block_sector_t);
+static thread_func commit_thread;
+
+/* Initializes the journal.  If FORMAT is true, creates an empty
+   journal.  Otherwise, replays any committed batch found in the
+   journal, or disables journaling if the file system predates
+   the journal. */
+void
+journal_init (bool format)
+{
+  lock_init (&journal_lock);
+  cond_init (&changed);
+
+  ASSERT (sizeof *header == BLOCK_SECTOR_SIZE);
+  header = calloc (1, sizeof *header);
+  images = malloc (JOURNAL_RECORDS * BLOCK_SECTOR_SIZE);
+  requests = malloc (JOURNAL_RECORDS * sizeof *requests);
+  if (header == NULL || images == NULL || requests == NULL)
+    PANIC ("can't allocate journal");
+
+  if (format)
+    {
+      header->magic = JOURNAL_MAGIC;
+      block_write (fs_device, JOURNAL_SECTOR, header);
+    }
+  else
+    {
+      block_read (fs_device, JOURNAL_SECTOR, header);
+      if (header->magic != JOURNAL_MAGIC)
+        return;
+      if (header->cnt > JOURNAL_RECORDS)
+        PANIC ("corrupt journal header");
+      if (header->cnt > 0)
+        {
+          printf ("Replaying %"PRIu32" journaled sectors...\n", header->cnt);
+          block_read_multiple (fs_device, JOURNAL_SECTOR + 1, header->cnt,
+                               images);
+          write_home ();
+        }
+    }
+
+  enabled = true;
+  if (thread_create ("journal", PRI_DEFAULT, commit_thread, NULL)
+      == TID_ERROR)
+    PANIC ("can't start journal thread");
+}
+
+/* Returns true if metadata updates are being journaled. */
+bool
+journal_enabled (void)
+{
+  return enabled;
+}
+
+/* Begins a transaction, which may write up to JOURNAL_TXN_MAX
+   distinct sectors with journal_write().  Transactions may not
+   be nested. */
+void
+journal_begin (void)
+{
+  /* The commit itself may update metadata while the batch is
+     being completed. */
+  if (!enabled || committer == thread_current ())
+    return;
+
+  lock_acquire (&journal_lock);
+  for (;;)
+    {
+      if (committing)
+        cond_wait (&changed, &journal_lock);
+      else if (header->cnt + (active + 1) * JOURNAL_TXN_MAX
+               <= JOURNAL_RECORDS)
+        break;
+      else if (active == 0)
+        commit ();
+      else
+        cond_wait (&changed, &journal_lock);
+    }
+  active++;
+  lock_release (&journal_lock);
+}
+
+/* Ends a transaction begun with journal_begin().  Its updates
+   become durable with the next commit. */
+void
+journal_end (void)
+{
+  if (!enabled || committer == thread_current ())
+    return;
+
+  lock_acquire (&journal_lock);
+  ASSERT (active > 0);
+  if (--active == 0)
+    cond_broadcast (&changed, &journal_lock);
+  lock_release (&journal_lock);
+}
+
+/* Reads metadata sector SECTOR into BUFFER, taking any newer
+   contents from the running batch. */
+void
+journal_read (block_sector_t sector, void *buffer)
+{
+  int i;
+
+  if (enabled)
+    {
+      lock_acquire (&journal_lock);
+      i = find_record (sector);
+      if (i >= 0)
+        memcpy (buffer, images + i * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE);
+      lock_release (&journal_lock);
+      if (i >= 0)
+        return;
+    }
+  block_read (fs_device, sector, buffer);
+}
+
+/* Writes BUFFER to metadata sector SECTOR, as part of the
+   current transaction. */
+void
+journal_write (block_sector_t sector, const void *buffer)
+{
+  int i;
+
+  if (!enabled)
+    {
+      block_write (fs_device, sector, buffer);
+      return;
+    }
+
+  lock_acquire (&journal_lock);
+  ASSERT (active > 0 || committer == thread_current ());
+  i = find_record (sector);
+  if (i < 0)
+    {
+      ASSERT (header->cnt < JOURNAL_RECORDS);
+      i = header->cnt++;
+      header->sectors[i] = sector;
+    }
+  memcpy (images + i * BLOCK_SECTOR_SIZE, buffer, BLOCK_SECTOR_SIZE);
+  lock_release (&journal_lock);
+}
+
+/* Commits all finished transactions, waiting for any in
+   progress to finish first. */
+void
+journal_flush (void)
+{
+  if (!enabled)
+    return;
+
+  lock_acquire (&journal_lock);
+  while (committing)
+    cond_wait (&changed, &journal_lock);
+  commit ();
+  lock_release (&journal_lock);
+}
+
+/* Commits the running batch.  New transactions are held off
+   until the commit is complete.
+   The caller must hold journal_lock, which is released and
+   reacquired along the way. */
+static void
+commit (void)
+{
+  ASSERT (lock_held_by_current_thread (&journal_lock));
+  ASSERT (!committing);
+
+  committing = true;
+  while (active > 0)
+    cond_wait (&changed, &journal_lock);
+  committer = thread_current ();
+
+  /* The free map must be on disk before anything that refers to
+     the sectors it allocates. */
+  lock_release (&journal_lock);
+  free_map_flush ();
+  lock_acquire (&journal_lock);
+
+  if (header->cnt > 0)
+    {
+      /* Write the log, then the header, which is the commit
+         point.  The device may reorder writes in its cache, so
+         flush it first to make file data and the free map
+         durable before the metadata that refers to them, and
+         again to make the log durable before the header. */
+      block_flush (fs_device);
+      block_write_multiple (fs_device, JOURNAL_SECTOR + 1, header->cnt,
+                            images);
+      block_flush (fs_device);
+      block_write (fs_device, JOURNAL_SECTOR, header);
+      write_home ();
+    }
+
+  /* Sectors released by the committed transactions may now be
+     reused. */
+  lock_release (&journal_lock);
+  free_map_commit ();
+  lock_acquire (&journal_lock);
+
+  committer = NULL;
+  committing = false;
+  cond_broadcast (&changed, &journal_lock);
+}
+
+/* Writes each image in the batch to its home location, then
+   clears the journal header and empties the batch.  The writes
+   are issued together so that the block layer can sort and merge
+   them. */
+static void
+write_home (void)
+{
+  size_t i;
+
+  for (i = 0; i < header->cnt; i++)
+    {
+      struct block_request *r = &requests[i];
+      r->write = true;
+      r->sector = header->sectors[i];
+      r->cnt = 1;
+      r->buffer = images + i * BLOCK_SECTOR_SIZE;
+      r->callback = NULL;
+      block_submit (fs_device, r);
+    }
+  for (i = 0; i < header->cnt; i++)
+    block_wait (&requests[i]);
+
+  /* The images must be durable at home before the journal
+     forgets them. */
+  block_flush (fs_device);
+  header->cnt = 0;
+  block_write (fs_device, JOURNAL_SECTOR, header);
+}
+
+/* Returns the index of SECTOR's image in the running batch, or
+   -1 if it has none.
+   The caller must hold journal_lock. */
+static int
+find_record (block_sector_t sector)
+{
+  size_t i;
+
+  for (i = 0; i < header->cnt; i++)
+    if (header->sectors[i] == sector)
+      return i;
+  return -1;
+}
+
+/* Background thread that commits the running batch
+   periodically. */
+static void
+commit_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (COMMIT_INTERVAL);
+      lock_acquire (&journal_lock);
+      if (!committing && header->cnt > 0)
+        commit ();
+      lock_release (&journal_lock);
+    }
+}
@@ -0,0 +1,25 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* Maximum number of sector images in one commit. */
+#define JOURNAL_RECORDS 63
+
+/* Sectors occupied by the journal, starting at JOURNAL_SECTOR:
+   a header followed by space for JOURNAL_RECORDS images. */
+#define JOURNAL_SECTORS (1 + JOURNAL_RECORDS)
+
+/* Maximum number of distinct sectors one transaction may write. */
+#define JOURNAL_TXN_MAX 8
+
+void journal_init (bool format);
+bool journal_enabled (void);
+void journal_begin (void);
+void journal_end (void);
+void journal_read (block_sector_t, void *);
+void journal_write (block_sector_t, const void *);
+void journal_flush (void);
+
+#endif /* filesys/journal.h */
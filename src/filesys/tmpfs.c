@@ -0,0 +1,350 @@
+#include "filesys/tmpfs.h"
+#include <debug.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* A file system kept entirely in memory, for scratch files that
+   need not survive a reboot.  Files are named by paths that
+   begin with TMPFS_PREFIX, and like the disk file system there
+   is a single directory.
+
+   File data is kept in pages that are allocated as they are
+   first written, so a sparse or newly created file takes no
+   memory for the parts never written, which read as zeros.  The
+   pages come from the user pool, since they hold user data and
+   the kernel pool is much smaller.  No file data ever goes
+   through the block layer. */
+
+/* An in-memory file. */
+struct tmpfs_file
+  {
+    /* Protected by tmpfs_lock. */
+    struct list_elem elem;              /* Element in file list. */
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
+    int open_cnt;                       /* Number of openers. */
+    bool removed;                       /* Removed from the file list? */
+
+    /* Protected by LOCK. */
+    struct lock lock;
+    int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    off_t length;                       /* File size in bytes. */
+    size_t page_cnt;                    /* Number of elements in PAGES. */
+    uint8_t **pages;                    /* Data pages, null if unwritten. */
+  };
+
+/* List of files, and the lock that protects it. */
+static struct list files;
+static struct lock tmpfs_lock;
+
+static struct tmpfs_file *lookup (const char *name);
+static uint8_t *get_page (struct tmpfs_file *, size_t page_idx);
+static void destroy (struct tmpfs_file *);
+
+/* Initializes the tmpfs. */
+void
+tmpfs_init (void)
+{
+  list_init (&files);
+  lock_init (&tmpfs_lock);
+}
+
+/* If PATH names a file in the tmpfs, returns the file's name
+   within the tmpfs.  Otherwise, returns a null pointer. */
+const char *
+tmpfs_name (const char *path)
+{
+  size_t prefix_len = strlen (TMPFS_PREFIX);
+
+  if (strlen (path) < prefix_len || memcmp (path, TMPFS_PREFIX, prefix_len))
+    return NULL;
+  return path + prefix_len;
+}
+
+/* Creates a file named NAME that reads as INITIAL_SIZE zeros.
+   Returns true if successful, false otherwise.
+   Fails if a file named NAME already exists, if NAME is invalid,
+   or if internal memory allocation fails. */
+bool
+tmpfs_create (const char *name, off_t initial_size)
+{
+  struct tmpfs_file *file;
+  bool success = false;
+
+  ASSERT (initial_size >= 0);
+
+  /* Check NAME for validity. */
+  if (*name == '\0' || strlen (name) > NAME_MAX || strchr (name, '/'))
+    return false;
+
+  lock_acquire (&tmpfs_lock);
+  if (lookup (name) == NULL)
+    {
+      file = calloc (1, sizeof *file);
+      if (file != NULL)
+        {
+          strlcpy (file->name, name, sizeof file->name);
+          lock_init (&file->lock);
+          file->length = initial_size;
+          list_push_back (&files, &file->elem);
+          success = true;
+        }
+    }
+  lock_release (&tmpfs_lock);
+
+  return success;
+}
+
+/* Opens the file named NAME and returns it, or a null pointer if
+   there is no such file. */
+struct tmpfs_file *
+tmpfs_open (const char *name)
+{
+  struct tmpfs_file *file;
+
+  lock_acquire (&tmpfs_lock);
+  file = lookup (name);
+  if (file != NULL)
+    file->open_cnt++;
+  lock_release (&tmpfs_lock);
+
+  return file;
+}
+
+/* Reopens and returns FILE. */
+struct tmpfs_file *
+tmpfs_reopen (struct tmpfs_file *file)
+{
+  if (file != NULL)
+    {
+      lock_acquire (&tmpfs_lock);
+      file->open_cnt++;
+      lock_release (&tmpfs_lock);
+    }
+  return file;
+}
+
+/* Closes FILE.  If this was the last reference to a removed
+   file, frees its memory. */
+void
+tmpfs_close (struct tmpfs_file *file)
+{
+  bool last;
+
+  if (file == NULL)
+    return;
+
+  lock_acquire (&tmpfs_lock);
+  last = --file->open_cnt == 0 && file->removed;
+  lock_release (&tmpfs_lock);
+
+  if (last)
+    destroy (file);
+}
+
+/* Removes the file named NAME.  Its memory is freed when the
+   last opener closes it.
+   Returns true if successful, false if there is no such file. */
+bool
+tmpfs_remove (const char *name)
+{
+  struct tmpfs_file *file;
+  bool unused = false;
+
+  lock_acquire (&tmpfs_lock);
+  file = lookup (name);
+  if (file != NULL)
+    {
+      list_remove (&file->elem);
+      file->removed = true;
+      unused = file->open_cnt == 0;
+    }
+  lock_release (&tmpfs_lock);
+
+  if (unused)
+    destroy (file);
+  return file != NULL;
+}
+
+/* Reads SIZE bytes from FILE into BUFFER, starting at position
+   OFFSET.  Returns the number of bytes actually read, which may
+   be less than SIZE if end of file is reached. */
+off_t
+tmpfs_read_at (struct tmpfs_file *file, void *buffer_, off_t size,
+               off_t offset)
+{
+  uint8_t *buffer = buffer_;
+  off_t bytes_read = 0;
+
+  lock_acquire (&file->lock);
+  while (size > 0)
+    {
+      /* Page to read, starting byte offset within page. */
+      size_t page_idx = offset / PGSIZE;
+      int page_ofs = offset % PGSIZE;
+
+      /* Bytes left in file, bytes left in page, lesser of the two. */
+      off_t file_left = file->length - offset;
+      int page_left = PGSIZE - page_ofs;
+      int min_left = file_left < page_left ? file_left : page_left;
+
+      /* Number of bytes to actually copy out of this page. */
+      int chunk_size = size < min_left ? size : min_left;
+      if (chunk_size <= 0)
+        break;
+
+      if (page_idx < file->page_cnt && file->pages[page_idx] != NULL)
+        memcpy (buffer + bytes_read, file->pages[page_idx] + page_ofs,
+                chunk_size);
+      else
+        memset (buffer + bytes_read, 0, chunk_size);
+
+      /* Advance. */
+      size -= chunk_size;
+      offset += chunk_size;
+      bytes_read += chunk_size;
+    }
+  lock_release (&file->lock);
+
+  return bytes_read;
+}
+
+/* Writes SIZE bytes from BUFFER into FILE, starting at OFFSET,
+   extending the file if necessary.  Returns the number of bytes
+   actually written, which may be less than SIZE if memory runs
+   out or writes are denied. */
+off_t
+tmpfs_write_at (struct tmpfs_file *file, const void *buffer_, off_t size,
+                off_t offset)
+{
+  const uint8_t *buffer = buffer_;
+  off_t bytes_written = 0;
+
+  lock_acquire (&file->lock);
+  if (file->deny_write_cnt == 0)
+    while (size > 0)
+      {
+        /* Page to write, starting byte offset within page. */
+        uint8_t *page = get_page (file, offset / PGSIZE);
+        int page_ofs = offset % PGSIZE;
+
+        /* Number of bytes to actually write into this page. */
+        int page_left = PGSIZE - page_ofs;
+        int chunk_size = size < page_left ? size : page_left;
+        if (page == NULL)
+          break;
+
+        memcpy (page + page_ofs, buffer + bytes_written, chunk_size);
+
+        /* Advance. */
+        size -= chunk_size;
+        offset += chunk_size;
+        bytes_written += chunk_size;
+      }
+  if (offset > file->length && bytes_written > 0)
+    file->length = offset;
+  lock_release (&file->lock);
+
+  return bytes_written;
+}
+
+/* Disables writes to FILE.
+   May be called at most once per opener. */
+void
+tmpfs_deny_write (struct tmpfs_file *file)
+{
+  lock_acquire (&file->lock);
+  file->deny_write_cnt++;
+  lock_release (&file->lock);
+}
+
+/* Re-enables writes to FILE.
+   Must be called once by each opener who has called
+   tmpfs_deny_write() on the file, before closing it. */
+void
+tmpfs_allow_write (struct tmpfs_file *file)
+{
+  lock_acquire (&file->lock);
+  ASSERT (file->deny_write_cnt > 0);
+  file->deny_write_cnt--;
+  lock_release (&file->lock);
+}
+
+/* Returns the length, in bytes, of FILE's data. */
+off_t
+tmpfs_length (struct tmpfs_file *file)
+{
+  off_t length;
+
+  lock_acquire (&file->lock);
+  length = file->length;
+  lock_release (&file->lock);
+
+  return length;
+}
+
+/* Returns the file named NAME, or a null pointer if there is
+   none.
+   The caller must hold tmpfs_lock. */
+static struct tmpfs_file *
+lookup (const char *name)
+{
+  struct list_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&tmpfs_lock));
+  for (e = list_begin (&files); e != list_end (&files); e = list_next (e))
+    {
+      struct tmpfs_file *file = list_entry (e, struct tmpfs_file, elem);
+      if (!strcmp (file->name, name))
+        return file;
+    }
+  return NULL;
+}
+
+/* Returns page PAGE_IDX of FILE, allocating it, and growing
+   FILE's page array to hold it, if necessary.  Returns a null
+   pointer if memory runs out.
+   The caller must hold FILE's lock. */
+static uint8_t *
+get_page (struct tmpfs_file *file, size_t page_idx)
+{
+  ASSERT (lock_held_by_current_thread (&file->lock));
+
+  if (page_idx >= file->page_cnt)
+    {
+      /* Grow geometrically so that appending is cheap. */
+      size_t new_cnt = file->page_cnt * 2;
+      uint8_t **pages;
+
+      if (new_cnt <= page_idx)
+        new_cnt = page_idx + 1;
+      pages = realloc (file->pages, new_cnt * sizeof *pages);
+      if (pages == NULL)
+        return NULL;
+      memset (pages + file->page_cnt, 0,
+              (new_cnt - file->page_cnt) * sizeof *pages);
+      file->pages = pages;
+      file->page_cnt = new_cnt;
+    }
+
+  if (file->pages[page_idx] == NULL)
+    file->pages[page_idx] = palloc_get_page (PAL_USER | PAL_ZERO);
+  return file->pages[page_idx];
+}
+
+/* Frees FILE and its data pages. */
+static void
+destroy (struct tmpfs_file *file)
+{
+  size_t i;
+
+  for (i = 0; i < file->page_cnt; i++)
+    if (file->pages[i] != NULL)
+      palloc_free_page (file->pages[i]);
+  free (file->pages);
+  free (file);
+}
@@ -0,0 +1,30 @@
+#ifndef FILESYS_TMPFS_H
+#define FILESYS_TMPFS_H
+
+#include <stdbool.h>
+#include "filesys/off_t.h"
+
+/* Names that begin with this prefix are in the tmpfs. */
+#define TMPFS_PREFIX "/tmp/"
+
+struct tmpfs_file;
+
+void tmpfs_init (void);
+const char *tmpfs_name (const char *path);
+
+/* Creating, opening, and removing files. */
+bool tmpfs_create (const char *name, off_t initial_size);
+struct tmpfs_file *tmpfs_open (const char *name);
+struct tmpfs_file *tmpfs_reopen (struct tmpfs_file *);
+void tmpfs_close (struct tmpfs_file *);
+bool tmpfs_remove (const char *name);
+
+/* Reading and writing. */
+off_t tmpfs_read_at (struct tmpfs_file *, void *, off_t size, off_t offset);
+off_t tmpfs_write_at (struct tmpfs_file *, const void *, off_t size,
+                      off_t offset);
+void tmpfs_deny_write (struct tmpfs_file *);
+void tmpfs_allow_write (struct tmpfs_file *);
+off_t tmpfs_length (struct tmpfs_file *);
+
+#endif /* filesys/tmpfs.h */
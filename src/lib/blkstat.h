@@ -0,0 +1,27 @@
+#ifndef __LIB_BLKSTAT_H
+#define __LIB_BLKSTAT_H
+
+/* Block device statistics, as returned by the blkstats() system
+   call.  Latencies are in CPU timestamp counter cycles, measured
+   from when a request is issued to the block layer until it
+   completes, so they include time spent waiting in the queue. */
+
+/* Number of latency histogram buckets.  Bucket 0 counts
+   latencies under 2 cycles, bucket I > 0 counts latencies from
+   2**I to 2**(I+1) - 1 cycles, and the last bucket also counts
+   anything longer. */
+#define BLKSTAT_BUCKETS 40
+
+struct blkstat
+  {
+    unsigned long long read_cnt;        /* Read requests completed. */
+    unsigned long long write_cnt;       /* Write requests completed. */
+    unsigned long long read_bytes;      /* Bytes read. */
+    unsigned long long write_bytes;     /* Bytes written. */
+    unsigned long long total_cycles;    /* Sum of request latencies. */
+    unsigned long long max_cycles;      /* Longest request latency. */
+    unsigned max_outstanding;           /* Most requests in progress at once. */
+    unsigned long long histogram[BLKSTAT_BUCKETS]; /* Latency histogram. */
+  };
+
+#endif /* lib/blkstat.h */
@@ -0,0 +1,19 @@
+#ifndef __LIB_DIRENT_H
+#define __LIB_DIRENT_H
+
+#include <stdbool.h>
+
+/* Maximum characters in a name in a struct dirent. */
+#define DIRENT_NAME_MAX 14
+
+/* One directory entry, as returned by the getdents() system
+   call.  Entries are packed one after another in the caller's
+   buffer. */
+struct dirent
+  {
+    int d_ino;                          /* Inode number. */
+    bool d_isdir;                       /* True if a directory. */
+    char d_name[DIRENT_NAME_MAX + 1];   /* Null terminated name. */
+  };
+
+#endif /* lib/dirent.h */
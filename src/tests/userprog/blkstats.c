@@ -0,0 +1,35 @@
+/* Reads a file and checks that the statistics for the file
+   system device account for the reads, and that asking for a
+   nonexistent device fails.  The file read is the test's own
+   executable, which is too big to be stored inline in its inode
+   and isn't journaled, so reading it must go to disk. */
+
+#include <blkstat.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct blkstat before, after;
+  char buf[512];
+  int handle;
+
+  CHECK (blkstats ("filesys", &before), "blkstats \"filesys\"");
+  CHECK ((handle = open ("blkstats")) > 1, "open \"blkstats\"");
+  CHECK (read (handle, buf, sizeof buf) == sizeof buf, "read \"blkstats\"");
+  CHECK (blkstats ("filesys", &after), "blkstats \"filesys\" again");
+
+  if (after.read_cnt <= before.read_cnt)
+    fail ("read count did not increase");
+  if (after.read_bytes < before.read_bytes + 512)
+    fail ("read byte count did not increase by a sector or more");
+  if (after.max_outstanding < 1)
+    fail ("max outstanding requests is %u", after.max_outstanding);
+  if (after.max_cycles == 0 || after.total_cycles < after.max_cycles)
+    fail ("bad latency totals");
+
+  CHECK (!blkstats ("no-such-device", &after),
+         "blkstats \"no-such-device\" (must return false)");
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(blkstats) begin
+(blkstats) blkstats "filesys"
+(blkstats) open "blkstats"
+(blkstats) read "blkstats"
+(blkstats) blkstats "filesys" again
+(blkstats) blkstats "no-such-device" (must return false)
+(blkstats) end
+blkstats: exit(0)
+EOF
+pass;
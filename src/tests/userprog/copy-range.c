@@ -0,0 +1,42 @@
+/* Copies part of this test's own executable into "sample.txt"
+   with copy_file_range(), starting away from a sector boundary,
+   and checks that both file positions move past the copy. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define COPY_SIZE 1000
+
+void
+test_main (void) 
+{
+  char expected[COPY_SIZE + 4];
+  char buf[100], next[100];
+  int in, out;
+
+  CHECK ((in = open ("copy-range")) > 1, "open \"copy-range\"");
+  CHECK ((out = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (pread (in, expected, COPY_SIZE, sizeof buf) == COPY_SIZE,
+         "pread %d bytes", COPY_SIZE);
+  memcpy (expected + COPY_SIZE, "tail", 4);
+  CHECK (pread (in, next, sizeof next, sizeof buf + COPY_SIZE)
+         == sizeof next, "pread %zu bytes", sizeof next);
+
+  CHECK (read (in, buf, sizeof buf) == sizeof buf,
+         "read %zu bytes", sizeof buf);
+  CHECK (copy_file_range (in, out, COPY_SIZE) == COPY_SIZE,
+         "copy %d bytes", COPY_SIZE);
+  CHECK (read (in, buf, sizeof buf) == sizeof buf,
+         "read %zu bytes", sizeof buf);
+  compare_bytes (buf, next, sizeof buf, sizeof buf + COPY_SIZE,
+                 "copy-range");
+  CHECK (write (out, "tail", 4) == 4, "write 4 bytes");
+
+  CHECK (copy_file_range (in, 0x20101234, 10) == -1,
+         "copy to bad fd (must return -1)");
+  msg ("close \"sample.txt\"");
+  close (out);
+  check_file ("sample.txt", expected, sizeof expected);
+}
@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(copy-range) begin
+(copy-range) open "copy-range"
+(copy-range) open "sample.txt"
+(copy-range) pread 1000 bytes
+(copy-range) pread 100 bytes
+(copy-range) read 100 bytes
+(copy-range) copy 1000 bytes
+(copy-range) read 100 bytes
+(copy-range) write 4 bytes
+(copy-range) copy to bad fd (must return -1)
+(copy-range) close "sample.txt"
+(copy-range) open "sample.txt" for verification
+(copy-range) verified contents of "sample.txt"
+(copy-range) close "sample.txt"
+(copy-range) end
+copy-range: exit(0)
+EOF
+pass;
@@ -0,0 +1,30 @@
+/* Writes to a file, makes the change durable with fsync() and
+   sync(), and checks that fsync() on a bad file descriptor
+   fails. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char data[600];
+
+void
+test_main (void) 
+{
+  int handle;
+  size_t i;
+
+  for (i = 0; i < sizeof data; i++)
+    data[i] = 'a' + i % 26;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (write (handle, data, sizeof data) == sizeof data,
+         "write \"sample.txt\"");
+  CHECK (fsync (handle), "fsync \"sample.txt\"");
+  CHECK (!fsync (0x20101234), "fsync bad fd (must return false)");
+  msg ("sync");
+  sync ();
+  msg ("close \"sample.txt\"");
+  close (handle);
+  check_file ("sample.txt", data, sizeof data);
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fsync) begin
+(fsync) open "sample.txt"
+(fsync) write "sample.txt"
+(fsync) fsync "sample.txt"
+(fsync) fsync bad fd (must return false)
+(fsync) sync
+(fsync) close "sample.txt"
+(fsync) open "sample.txt" for verification
+(fsync) verified contents of "sample.txt"
+(fsync) close "sample.txt"
+(fsync) end
+fsync: exit(0)
+EOF
+pass;
@@ -0,0 +1,55 @@
+/* Lists the root directory with getdents(), first with room for
+   every entry and then one entry per call, and checks that
+   getdents() refuses to list a file. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Returns the entry named NAME among the CNT in ENTRIES, or a
+   null pointer if there is none. */
+static struct dirent *
+find (struct dirent *entries, int cnt, const char *name)
+{
+  int i;
+
+  for (i = 0; i < cnt; i++)
+    if (!strcmp (entries[i].d_name, name))
+      return &entries[i];
+  return NULL;
+}
+
+void
+test_main (void) 
+{
+  struct dirent entries[16];
+  struct dirent *e;
+  int handle, cnt, one_cnt, n;
+
+  CHECK ((handle = open ("/")) > 1, "open \"/\"");
+  cnt = getdents (handle, entries, sizeof entries);
+  CHECK (cnt > 0 && cnt < 16, "getdents");
+  CHECK ((e = find (entries, cnt, "getdents")) != NULL && !e->d_isdir,
+         "found \"getdents\"");
+  CHECK ((e = find (entries, cnt, "sample.txt")) != NULL && !e->d_isdir,
+         "found \"sample.txt\"");
+  CHECK (getdents (handle, entries, sizeof entries) == 0,
+         "getdents at end of directory");
+  msg ("close \"/\"");
+  close (handle);
+
+  CHECK ((handle = open (".")) > 1, "open \".\"");
+  for (one_cnt = 0; (n = getdents (handle, entries, sizeof *entries)) == 1;
+       one_cnt++)
+    continue;
+  CHECK (n == 0 && one_cnt == cnt, "getdents one entry at a time");
+  msg ("close \".\"");
+  close (handle);
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (getdents (handle, entries, sizeof entries) == -1,
+         "getdents on file (must return -1)");
+  msg ("close \"sample.txt\"");
+  close (handle);
+}
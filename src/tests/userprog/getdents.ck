@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(getdents) begin
+(getdents) open "/"
+(getdents) getdents
+(getdents) found "getdents"
+(getdents) found "sample.txt"
+(getdents) getdents at end of directory
+(getdents) close "/"
+(getdents) open "."
+(getdents) getdents one entry at a time
+(getdents) close "."
+(getdents) open "sample.txt"
+(getdents) getdents on file (must return -1)
+(getdents) close "sample.txt"
+(getdents) end
+getdents: exit(0)
+EOF
+pass;
@@ -0,0 +1,47 @@
+/* Grows two files at once, in alternating writes, far past the
+   size of inline data, and checks that both end up with the
+   right contents. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHUNK_SIZE 1000
+#define CHUNK_CNT 4
+
+static char buf_a[CHUNK_SIZE * CHUNK_CNT];
+static char buf_b[CHUNK_SIZE * CHUNK_CNT];
+
+void
+test_main (void) 
+{
+  int a, b;
+  int i;
+
+  for (i = 0; i < CHUNK_SIZE * CHUNK_CNT; i++)
+    {
+      buf_a[i] = i % 253;
+      buf_b[i] = i % 127;
+    }
+
+  CHECK (create ("a", 0), "create \"a\"");
+  CHECK (create ("b", 0), "create \"b\"");
+  CHECK ((a = open ("a")) > 1, "open \"a\"");
+  CHECK ((b = open ("b")) > 1, "open \"b\"");
+  for (i = 0; i < CHUNK_CNT; i++)
+    {
+      CHECK (write (a, buf_a + i * CHUNK_SIZE, CHUNK_SIZE) == CHUNK_SIZE,
+             "write \"a\" chunk %d", i);
+      CHECK (write (b, buf_b + i * CHUNK_SIZE, CHUNK_SIZE) == CHUNK_SIZE,
+             "write \"b\" chunk %d", i);
+    }
+  CHECK (filesize (a) == sizeof buf_a, "filesize \"a\" is %zu",
+         sizeof buf_a);
+  msg ("close \"a\"");
+  close (a);
+  msg ("close \"b\"");
+  close (b);
+
+  check_file ("a", buf_a, sizeof buf_a);
+  check_file ("b", buf_b, sizeof buf_b);
+}
@@ -0,0 +1,31 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(grow-delayed) begin
+(grow-delayed) create "a"
+(grow-delayed) create "b"
+(grow-delayed) open "a"
+(grow-delayed) open "b"
+(grow-delayed) write "a" chunk 0
+(grow-delayed) write "b" chunk 0
+(grow-delayed) write "a" chunk 1
+(grow-delayed) write "b" chunk 1
+(grow-delayed) write "a" chunk 2
+(grow-delayed) write "b" chunk 2
+(grow-delayed) write "a" chunk 3
+(grow-delayed) write "b" chunk 3
+(grow-delayed) filesize "a" is 4000
+(grow-delayed) close "a"
+(grow-delayed) close "b"
+(grow-delayed) open "a" for verification
+(grow-delayed) verified contents of "a"
+(grow-delayed) close "a"
+(grow-delayed) open "b" for verification
+(grow-delayed) verified contents of "b"
+(grow-delayed) close "b"
+(grow-delayed) end
+grow-delayed: exit(0)
+EOF
+pass;
@@ -0,0 +1,40 @@
+/* Overwrites a small file with longer data, first while its
+   data still fits inside the inode and then with enough that it
+   has to be moved out to data sectors, and verifies the contents
+   each time. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char data[700];
+
+/* Writes the first SIZE bytes of DATA at the start of
+   "sample.txt", then checks that the file holds just those. */
+static void
+write_and_check (size_t size) 
+{
+  int handle;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (write (handle, data, size) == (int) size,
+         "write %zu bytes", size);
+  msg ("close \"sample.txt\"");
+  close (handle);
+  check_file ("sample.txt", data, size);
+}
+
+void
+test_main (void) 
+{
+  size_t i;
+
+  for (i = 0; i < sizeof data; i++)
+    data[i] = i % 251;
+
+  /* Grow while still inline. */
+  write_and_check (300);
+
+  /* Grow past what fits in the inode. */
+  write_and_check (700);
+}
@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(grow-inline) begin
+(grow-inline) open "sample.txt"
+(grow-inline) write 300 bytes
+(grow-inline) close "sample.txt"
+(grow-inline) open "sample.txt" for verification
+(grow-inline) verified contents of "sample.txt"
+(grow-inline) close "sample.txt"
+(grow-inline) open "sample.txt"
+(grow-inline) write 700 bytes
+(grow-inline) close "sample.txt"
+(grow-inline) open "sample.txt" for verification
+(grow-inline) verified contents of "sample.txt"
+(grow-inline) close "sample.txt"
+(grow-inline) end
+grow-inline: exit(0)
+EOF
+pass;
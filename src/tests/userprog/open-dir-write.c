@@ -0,0 +1,38 @@
+/* Opens the root directory, checks that files can still be
+   created in and removed from it while it is open, and that the
+   directory itself cannot be written through its handle. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  struct iovec iov;
+  char buf[16] = "0123456789abcde";
+  int dir, file;
+
+  CHECK ((dir = open ("/")) > 1, "open \"/\"");
+  CHECK (create ("newfile", 0), "create \"newfile\"");
+  CHECK ((file = open ("newfile")) > 1, "open \"newfile\"");
+  msg ("close \"newfile\"");
+  close (file);
+  CHECK (remove ("newfile"), "remove \"newfile\"");
+
+  CHECK (write (dir, buf, sizeof buf) == -1,
+         "write to directory (must return -1)");
+  CHECK (pwrite (dir, buf, sizeof buf, 0) == -1,
+         "pwrite to directory (must return -1)");
+  iov.iov_base = buf;
+  iov.iov_len = sizeof buf;
+  CHECK (writev (dir, &iov, 1) == -1,
+         "writev to directory (must return -1)");
+  CHECK ((file = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (copy_file_range (file, dir, sizeof buf) == -1,
+         "copy_file_range to directory (must return -1)");
+  msg ("close \"sample.txt\"");
+  close (file);
+  msg ("close \"/\"");
+  close (dir);
+}
@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(open-dir-write) begin
+(open-dir-write) open "/"
+(open-dir-write) create "newfile"
+(open-dir-write) open "newfile"
+(open-dir-write) close "newfile"
+(open-dir-write) remove "newfile"
+(open-dir-write) write to directory (must return -1)
+(open-dir-write) pwrite to directory (must return -1)
+(open-dir-write) writev to directory (must return -1)
+(open-dir-write) open "sample.txt"
+(open-dir-write) copy_file_range to directory (must return -1)
+(open-dir-write) close "sample.txt"
+(open-dir-write) close "/"
+(open-dir-write) end
+open-dir-write: exit(0)
+EOF
+pass;
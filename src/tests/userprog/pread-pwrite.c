@@ -0,0 +1,39 @@
+/* Reads and writes at given positions with pread() and pwrite(),
+   and checks that neither moves the position used by read() and
+   that offsets too big for a file position are rejected. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char expected[sizeof sample];
+  char buf[64];
+  int handle;
+
+  memcpy (expected, sample, sizeof sample);
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (pread (handle, buf, 50, 100) == 50, "pread 50 bytes at 100");
+  compare_bytes (buf, expected + 100, 50, 100, "sample.txt");
+
+  CHECK (pwrite (handle, "pwrite", 6, 20) == 6, "pwrite 6 bytes at 20");
+  memcpy (expected + 20, "pwrite", 6);
+
+  CHECK (read (handle, buf, 40) == 40, "read 40 bytes");
+  compare_bytes (buf, expected, 40, 0, "sample.txt");
+
+  CHECK (pread (0x20101234, buf, 10, 0) == -1,
+         "pread bad fd (must return -1)");
+  CHECK (pread (handle, buf, 10, 0xffffff00) == -1,
+         "pread at huge offset (must return -1)");
+  CHECK (pwrite (handle, "pwrite", 6, 0xffffff00) == -1,
+         "pwrite at huge offset (must return -1)");
+  msg ("close \"sample.txt\"");
+  close (handle);
+  check_file ("sample.txt", expected, sizeof sample - 1);
+}
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pread-pwrite) begin
+(pread-pwrite) open "sample.txt"
+(pread-pwrite) pread 50 bytes at 100
+(pread-pwrite) pwrite 6 bytes at 20
+(pread-pwrite) read 40 bytes
+(pread-pwrite) pread bad fd (must return -1)
+(pread-pwrite) pread at huge offset (must return -1)
+(pread-pwrite) pwrite at huge offset (must return -1)
+(pread-pwrite) close "sample.txt"
+(pread-pwrite) open "sample.txt" for verification
+(pread-pwrite) verified contents of "sample.txt"
+(pread-pwrite) close "sample.txt"
+(pread-pwrite) end
+pread-pwrite: exit(0)
+EOF
+pass;
@@ -0,0 +1,47 @@
+/* Writes a file from several buffers with writev() and reads it
+   back into differently sized buffers with readv(), and writes
+   to the console with writev(). */
+
+#include <string.h>
+#include <syscall.h>
+#include <uio.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char a[10], b[200], c[90];
+
+void
+test_main (void) 
+{
+  char expected[sizeof a + sizeof b + sizeof c];
+  char x[150], y[1], z[149];
+  struct iovec out[] = {{a, sizeof a}, {b, sizeof b}, {NULL, 0}, {c, sizeof c}};
+  struct iovec in[] = {{x, sizeof x}, {y, sizeof y}, {z, sizeof z}};
+  struct iovec console[] = {{"(readv-writev) ", 15}, {"writev to console\n", 18}};
+  int handle;
+
+  memset (a, 'a', sizeof a);
+  memset (b, 'b', sizeof b);
+  memset (c, 'c', sizeof c);
+  memcpy (expected, a, sizeof a);
+  memcpy (expected + sizeof a, b, sizeof b);
+  memcpy (expected + sizeof a + sizeof b, c, sizeof c);
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (writev (handle, out, 4) == sizeof expected, "writev 4 buffers");
+  msg ("close \"sample.txt\"");
+  close (handle);
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (readv (handle, in, 3) == sizeof x + sizeof y + sizeof z,
+         "readv 3 buffers");
+  compare_bytes (x, expected, sizeof x, 0, "sample.txt");
+  compare_bytes (y, expected + sizeof x, sizeof y, sizeof x, "sample.txt");
+  compare_bytes (z, expected + sizeof x + sizeof y, sizeof z,
+                 sizeof x + sizeof y, "sample.txt");
+  msg ("close \"sample.txt\"");
+  close (handle);
+
+  CHECK (writev (1, console, 2) == 33, "writev to console returned 33");
+  CHECK (readv (0x20101234, in, 3) == -1, "readv bad fd (must return -1)");
+}
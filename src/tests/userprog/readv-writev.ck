@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(readv-writev) begin
+(readv-writev) open "sample.txt"
+(readv-writev) writev 4 buffers
+(readv-writev) close "sample.txt"
+(readv-writev) open "sample.txt"
+(readv-writev) readv 3 buffers
+(readv-writev) close "sample.txt"
+(readv-writev) writev to console
+(readv-writev) writev to console returned 33
+(readv-writev) readv bad fd (must return -1)
+(readv-writev) end
+readv-writev: exit(0)
+EOF
+pass;
@@ -0,0 +1,40 @@
+/* Creates, writes, reads back, and removes a file in the tmpfs,
+   and checks that it does not appear on disk. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 5000
+
+static char buf[FILE_SIZE];
+static char buf2[FILE_SIZE];
+
+void
+test_main (void) 
+{
+  int handle;
+  size_t i;
+
+  for (i = 0; i < sizeof buf; i++)
+    buf[i] = i % 251;
+
+  CHECK (create ("/tmp/scratch", 0), "create \"/tmp/scratch\"");
+  CHECK (!create ("/tmp/scratch", 0),
+         "create \"/tmp/scratch\" again (must fail)");
+  CHECK ((handle = open ("/tmp/scratch")) > 1, "open \"/tmp/scratch\"");
+  CHECK (write (handle, buf, sizeof buf) == sizeof buf,
+         "write %zu bytes", sizeof buf);
+  CHECK (filesize (handle) == sizeof buf, "filesize is %zu", sizeof buf);
+  CHECK (pread (handle, buf2, sizeof buf2, 0) == sizeof buf2,
+         "pread %zu bytes", sizeof buf2);
+  compare_bytes (buf2, buf, sizeof buf, 0, "/tmp/scratch");
+  msg ("close \"/tmp/scratch\"");
+  close (handle);
+
+  CHECK (open ("scratch") == -1, "open \"scratch\" (must return -1)");
+  CHECK (remove ("/tmp/scratch"), "remove \"/tmp/scratch\"");
+  CHECK (open ("/tmp/scratch") == -1,
+         "open \"/tmp/scratch\" (must return -1)");
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(tmpfs) begin
+(tmpfs) create "/tmp/scratch"
+(tmpfs) create "/tmp/scratch" again (must fail)
+(tmpfs) open "/tmp/scratch"
+(tmpfs) write 5000 bytes
+(tmpfs) filesize is 5000
+(tmpfs) pread 5000 bytes
+(tmpfs) close "/tmp/scratch"
+(tmpfs) open "scratch" (must return -1)
+(tmpfs) remove "/tmp/scratch"
+(tmpfs) open "/tmp/scratch" (must return -1)
+(tmpfs) end
+tmpfs: exit(0)
+EOF
+pass;
@@ -0,0 +1,106 @@
+#ifndef THREADS_CPU_H
+#define THREADS_CPU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Helpers for CPU feature detection and control registers. */
+
+/* Feature bits returned in EDX by CPUID function 1.
+   See [IA32-v2a] "CPUID". */
+#define CPUID_PSE (1u << 3)     /* Page Size Extension (4 MB pages). */
+#define CPUID_PGE (1u << 13)    /* Page Global Enable. */
+#define CPUID_FXSR (1u << 24)   /* FXSAVE and FXRSTOR instructions. */
+#define CPUID_SSE (1u << 25)    /* Streaming SIMD Extensions. */
+
+/* CR0 bits.  See [IA32-v3a] 2.5 "Control Registers". */
+#define CR0_MP 0x00000002       /* Monitor Coprocessor. */
+#define CR0_EM 0x00000004       /* (Floating-point) Emulation. */
+#define CR0_TS 0x00000008       /* Task Switched. */
+#define CR0_NE 0x00000020       /* Native FPU error reporting. */
+
+/* CR4 bits.  See [IA32-v3a] 2.5 "Control Registers". */
+#define CR4_PSE 0x00000010      /* Page Size Extensions. */
+#define CR4_PGE 0x00000080      /* Page Global Enable. */
+#define CR4_OSFXSR 0x00000200   /* OS supports FXSAVE/FXRSTOR and SSE. */
+#define CR4_OSXMMEXCPT 0x00000400 /* OS handles SIMD FP exceptions. */
+
+/* Executes CPUID function FUNCTION and returns the feature flags
+   that it reports in EDX. */
+static inline uint32_t
+cpuid_edx (uint32_t function)
+{
+  /* See [IA32-v2a] "CPUID". */
+  uint32_t eax, ebx, ecx, edx;
+  asm volatile ("cpuid"
+                : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+                : "a" (function));
+  return edx;
+}
+
+/* Returns true if the CPU reports every bit in FEATURES in EDX
+   of CPUID function 1. */
+static inline bool
+cpu_has (uint32_t features)
+{
+  return (cpuid_edx (1) & features) == features;
+}
+
+/* Returns the contents of CR0. */
+static inline uint32_t
+cr0_read (void)
+{
+  /* See [IA32-v2a] "MOV--Move to/from Control Registers". */
+  uint32_t cr0;
+  asm volatile ("movl %%cr0, %0" : "=r" (cr0));
+  return cr0;
+}
+
+/* Stores CR0 into the CR0 register. */
+static inline void
+cr0_write (uint32_t cr0)
+{
+  /* See [IA32-v2a] "MOV--Move to/from Control Registers". */
+  asm volatile ("movl %0, %%cr0" : : "r" (cr0) : "memory");
+}
+
+/* Returns the contents of CR4. */
+static inline uint32_t
+cr4_read (void)
+{
+  /* See [IA32-v2a] "MOV--Move to/from Control Registers". */
+  uint32_t cr4;
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  return cr4;
+}
+
+/* Stores CR4 into the CR4 register. */
+static inline void
+cr4_write (uint32_t cr4)
+{
+  /* See [IA32-v2a] "MOV--Move to/from Control Registers". */
+  asm volatile ("movl %0, %%cr4" : : "r" (cr4) : "memory");
+}
+
+/* Returns the CPU's timestamp counter, which counts clock
+   cycles since reset. */
+static inline uint64_t
+rdtsc (void)
+{
+  /* See [IA32-v2b] "RDTSC". */
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Removes the TLB entry, if any, for the page containing virtual
+   address VADDR.  Unlike reloading CR3, this also drops an entry
+   for a global page. */
+static inline void
+invlpg (const void *vaddr)
+{
+  /* See [IA32-v2a] "INVLPG". */
+  asm volatile ("invlpg (%0)" : : "r" (vaddr) : "memory");
+}
+
+#endif /* threads/cpu.h */
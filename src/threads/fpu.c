@@ -0,0 +1,202 @@
+#include "threads/fpu.h"
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+
+/* Lazy FPU context switching.
+
+   The kernel itself is compiled with -msoft-float and never
+   touches the x87 or SSE registers, so only user programs need
+   their FPU state preserved.  Rather than saving and restoring
+   512 bytes of state on every context switch, we leave the
+   registers alone and set CR0.TS whenever we switch to a thread
+   other than the one whose state is currently loaded (the
+   "owner").  The first FPU or SSE instruction such a thread
+   executes raises #NM, and only then do we save the owner's
+   state and load the new thread's.  Threads that never use the
+   FPU never pay for it.
+
+   Each thread that has used the FPU has a save area, allocated
+   on first use and freed when the thread exits.  See [IA32-v3a]
+   12.5 "Designing OS Facilities for Saving x87 FPU, SSE and
+   Extended States on Task or Context Switches". */
+
+/* Size and required alignment of an FXSAVE area.
+   See [IA32-v2a] "FXSAVE". */
+#define FXSAVE_SIZE 512
+#define FXSAVE_ALIGN 16
+
+/* True if the CPU supports FXSAVE/FXRSTOR.  Otherwise CR0.EM
+   stays set, as start.S left it, and the FPU is unusable. */
+static bool fpu_enabled;
+
+/* Thread whose state is in the FPU registers, if any. */
+static struct thread *fpu_owner;
+
+/* Whether CR0.TS is currently set, to avoid redundant (and
+   slow) writes to CR0. */
+static bool ts_set;
+
+/* FPU state freshly initialized by FNINIT, copied into each
+   thread's save area on its first use of the FPU. */
+static uint8_t initial_state[FXSAVE_SIZE]
+  __attribute__ ((aligned (FXSAVE_ALIGN)));
+
+static void fpu_trap (struct intr_frame *);
+
+/* Returns the FXSAVE area of thread T, which must have one. */
+static void *
+save_area (struct thread *t)
+{
+  uintptr_t area = (uintptr_t) t->fpu;
+  return (void *) ((area + FXSAVE_ALIGN - 1) & ~(uintptr_t) (FXSAVE_ALIGN - 1));
+}
+
+/* Saves the FPU state into AREA. */
+static inline void
+fxsave (void *area)
+{
+  /* See [IA32-v2a] "FXSAVE". */
+  asm volatile ("fxsave (%0)" : : "r" (area) : "memory");
+}
+
+/* Loads the FPU state from AREA. */
+static inline void
+fxrstor (const void *area)
+{
+  /* See [IA32-v2a] "FXRSTOR". */
+  asm volatile ("fxrstor (%0)" : : "r" (area) : "memory");
+}
+
+/* Sets or clears CR0.TS according to TS. */
+static void
+set_ts (bool ts)
+{
+  if (ts != ts_set)
+    {
+      if (ts)
+        cr0_write (cr0_read () | CR0_TS);
+      else
+        asm volatile ("clts" : : : "memory");
+      ts_set = ts;
+    }
+}
+
+/* Enables the FPU and SSE units, if the CPU supports FXSAVE, and
+   registers the #NM handler that loads FPU state on demand.
+   Must be called after intr_init(). */
+void
+fpu_init (void)
+{
+  uint32_t cr4;
+
+  if (!cpu_has (CPUID_FXSR))
+    {
+      printf ("fpu: no FXSAVE support, floating point disabled\n");
+      return;
+    }
+
+  /* Tell the CPU that we save and restore SSE state and handle
+     SIMD floating-point exceptions, so that SSE instructions
+     don't raise #UD. */
+  cr4 = cr4_read () | CR4_OSFXSR;
+  if (cpu_has (CPUID_SSE))
+    cr4 |= CR4_OSXMMEXCPT;
+  cr4_write (cr4);
+
+  /* Stop emulating the FPU.  MP makes WAIT/FWAIT honor TS too,
+     and NE reports x87 errors through #MF rather than the
+     legacy external interrupt. */
+  cr0_write ((cr0_read () & ~(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE);
+  ts_set = false;
+
+  /* Capture a clean state for threads to start from. */
+  asm volatile ("fninit");
+  fxsave (initial_state);
+
+  fpu_enabled = true;
+  set_ts (true);
+  intr_register_int (7, 0, INTR_ON, fpu_trap,
+                     "#NM Device Not Available Exception");
+}
+
+/* Returns true if user programs may use the FPU. */
+bool
+fpu_available (void)
+{
+  return fpu_enabled;
+}
+
+/* Called during a context switch to NEXT, with interrupts off.
+   Arranges for NEXT's first FPU instruction to trap, unless its
+   state is already in the FPU registers. */
+void
+fpu_switch (struct thread *next)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (fpu_enabled)
+    set_ts (next != fpu_owner);
+}
+
+/* Frees thread T's FPU state.  Called by T as it exits. */
+void
+fpu_release (struct thread *t)
+{
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  if (fpu_owner == t)
+    fpu_owner = NULL;
+  intr_set_level (old_level);
+
+  free (t->fpu);
+  t->fpu = NULL;
+}
+
+/* #NM handler.  The running thread tried to use the FPU while
+   CR0.TS was set, so give it the FPU: save the previous owner's
+   state, if any, and load the running thread's. */
+static void
+fpu_trap (struct intr_frame *f)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  if ((f->cs & 3) == 0)
+    PANIC ("kernel used the FPU at %p", f->eip);
+
+  /* Allocate a save area on first use.  Do this before turning
+     interrupts off, since malloc() may sleep. */
+  if (cur->fpu == NULL)
+    {
+      cur->fpu = malloc (FXSAVE_SIZE + FXSAVE_ALIGN - 1);
+      if (cur->fpu == NULL)
+        {
+          printf ("%s: out of memory for FPU state\n", thread_name ());
+#ifdef USERPROG
+          cur->exit_code = -1;
+#endif
+          thread_exit ();
+        }
+      memcpy (save_area (cur), initial_state, FXSAVE_SIZE);
+    }
+
+  /* Switch FPU ownership atomically with respect to context
+     switches, which would otherwise set CR0.TS under us. */
+  old_level = intr_disable ();
+  set_ts (false);
+  if (fpu_owner != cur)
+    {
+      if (fpu_owner != NULL)
+        fxsave (save_area (fpu_owner));
+      fxrstor (save_area (cur));
+      fpu_owner = cur;
+    }
+  intr_set_level (old_level);
+}
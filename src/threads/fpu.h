@@ -0,0 +1,13 @@
+#ifndef THREADS_FPU_H
+#define THREADS_FPU_H
+
+#include <stdbool.h>
+
+struct thread;
+
+void fpu_init (void);
+bool fpu_available (void);
+void fpu_switch (struct thread *);
+void fpu_release (struct thread *);
+
+#endif /* threads/fpu.h */
@@ -15,6 +15,8 @@
 #include "devices/timer.h"
 #include "devices/vga.h"
 #include "devices/rtc.h"
+#include "threads/cpu.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
@@ -34,6 +36,9 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/ramdisk.h"
+#include "devices/stripe.h"
+#include "devices/virtio-blk.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
@@ -52,6 +57,18 @@ static const char *scratch_bdev_name;
 #ifdef VM
 static const char *swap_bdev_name;
 #endif
+
+/* -stripe: Comma-separated names of block devices to stripe
+   together into "md0". */
+static char *stripe_members;
+
+/* -ramdisk: Size in kB of RAM disk "rd0" to create, or 0 for
+   none. */
+static size_t ramdisk_kb;
+
+/* -spread: Prefer block devices on different buses for the
+   roles located by default? */
+static bool spread_roles;
 #endif /* FILESYS */
 
 /* -ul: Maximum number of pages to put into palloc's user pool. */
@@ -106,6 +123,7 @@ main( void ) {
 
   /* Initialize interrupt handlers. */
   intr_init();
+  fpu_init();
   timer_init();
   kbd_init();
   input_init();
@@ -122,6 +140,10 @@ main( void ) {
 #ifdef FILESYS
   /* Initialize file system. */
   ide_init();
+  virtio_blk_init();
+  ramdisk_init( ramdisk_kb );
+  if ( stripe_members != NULL )
+    stripe_create( "md0", stripe_members );
   locate_block_devices();
   filesys_init( format_filesys );
 #endif
@@ -151,12 +173,28 @@ bss_init( void ) {
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.
+
+   If the CPU supports 4 MB pages, each 4 MB region of physical
+   memory is mapped by a single PDE, which saves a page table per
+   region and lets one TLB entry cover the whole region.  The
+   region that contains kernel text keeps 4 kB pages so that the
+   text can stay read-only, as does any partial region at the end
+   of RAM. */
 static void
 paging_init( void ) {
   uint32_t *pd, *pt;
   size_t page;
   extern char _start, _end_kernel_text;
+  const size_t pages_per_pde = 1 << PTBITS;
+
+  /* Kernel mappings are identical in every page directory, so if
+     the CPU supports it we mark them global.  Global TLB entries
+     survive CR3 reloads, so switching processes only flushes
+     user mappings.  See [IA32-v3a] 3.11 "Translation Lookaside
+     Buffers (TLBs)". */
+  bool global = cpu_has( CPUID_PGE );
+  bool large = cpu_has( CPUID_PSE );
 
   pd = init_page_dir = palloc_get_page( PAL_ASSERT | PAL_ZERO );
   pt = NULL;
@@ -167,20 +205,39 @@ paging_init( void ) {
     size_t pte_idx = pt_no( vaddr );
     bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+    if ( large && pte_idx == 0 && page + pages_per_pde <= init_ram_pages
+      && ( vaddr + PTSPAN <= &_start || vaddr >= &_end_kernel_text ) ) {
+      pd[pde_idx] = pde_create_kernel_large( vaddr, true )
+        | ( global ? PTE_G : 0 );
+      page += pages_per_pde - 1;
+      continue;
+    }
+
     if ( pd[pde_idx] == 0 ) {
       pt = palloc_get_page( PAL_ASSERT | PAL_ZERO );
       pd[pde_idx] = pde_create( pt );
     }
 
-    pt[pte_idx] = pte_create_kernel( vaddr, !in_kernel_text );
+    pt[pte_idx] = pte_create_kernel( vaddr, !in_kernel_text )
+      | ( global ? PTE_G : 0 );
   }
 
+  /* 4 MB PDEs are only honored once CR4.PSE is set, so turn it on
+     before we start using them. */
+  if ( large )
+    cr4_write( cr4_read() | CR4_PSE );
+
   /* Store the physical address of the page directory into CR3
      aka PDBR (page directory base register).  This activates our
      new page tables immediately.  See [IA32-v2a] "MOV--Move
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base Address
      of the Page Directory". */
   asm volatile ( "movl %0, %%cr3" : : "r" ( vtop( init_page_dir ) ) );
+
+  /* Now that the global bits are in place, let the CPU honor
+     them. */
+  if ( global )
+    cr4_write( cr4_read() | CR4_PGE );
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -238,6 +295,12 @@ parse_options( char **argv ) {
       filesys_bdev_name = value;
     else if ( !strcmp( name, "-scratch" ) )
       scratch_bdev_name = value;
+    else if ( !strcmp( name, "-stripe" ) )
+      stripe_members = value;
+    else if ( !strcmp( name, "-spread" ) )
+      spread_roles = true;
+    else if ( !strcmp( name, "-ramdisk" ) )
+      ramdisk_kb = atoi( value );
 #ifdef VM
     else if ( !strcmp( name, "-swap" ) )
       swap_bdev_name = value;
@@ -301,6 +364,7 @@ run_actions( char **argv ) {
       {"ls", 1, fsutil_ls},
       {"cat", 2, fsutil_cat},
       {"rm", 2, fsutil_rm},
+      {"defrag", 1, fsutil_defrag},
       {"extract", 1, fsutil_extract},
       {"append", 2, fsutil_append},
 #endif
@@ -347,6 +411,7 @@ usage( void ) {
     "  ls                 List files in the root directory.\n"
     "  cat FILE           Print FILE to the console.\n"
     "  rm FILE            Delete FILE.\n"
+    "  defrag             Compact files and report free space.\n"
     "Use these actions indirectly via `pintos' -g and -p options:\n"
     "  extract            Untar from scratch device into file system.\n"
     "  append FILE        Append FILE to tar file on scratch device.\n"
@@ -359,6 +424,9 @@ usage( void ) {
     "  -f                 Format file system device during startup.\n"
     "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
     "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+    "  -stripe=BDEV,...   Stripe the BDEVs together into block device md0.\n"
+    "  -spread            Put default roles on different buses if possible.\n"
+    "  -ramdisk=KB        Create a KB kB RAM disk named rd0.\n"
 #ifdef VM
     "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
@@ -383,10 +451,28 @@ locate_block_devices( void ) {
 #endif
 }
 
+/* Returns true if a block device already assigned to a role is
+   on the same bus as BLOCK. */
+static bool
+bus_in_use( struct block *block ) {
+  enum block_type role;
+
+  if ( block_bus( block ) < 0 )
+    return false;
+  for ( role = 0; role < BLOCK_ROLE_CNT; role++ ) {
+    struct block *used = block_get_role( role );
+    if ( used != NULL && block_bus( used ) == block_bus( block ) )
+      return true;
+  }
+  return false;
+}
+
 /* Figures out what block device to use for the given ROLE: the
    block device with the given NAME, if NAME is non-null,
    otherwise the first block device in probe order of type
-   ROLE. */
+   ROLE.  With -spread, a device of type ROLE on a bus that no
+   other role uses yet is preferred, so that the roles can
+   transfer data in parallel. */
 static void
 locate_block_device( enum block_type role, const char *name ) {
   struct block *block = NULL;
@@ -400,6 +486,15 @@ locate_block_device( enum block_type role, const char *name ) {
     for ( block = block_first(); block != NULL; block = block_next( block ) )
       if ( block_type( block ) == role )
         break;
+
+    if ( spread_roles && block != NULL && bus_in_use( block ) ) {
+      struct block *b;
+      for ( b = block_next( block ); b != NULL; b = block_next( b ) )
+        if ( block_type( b ) == role && !bus_in_use( b ) ) {
+          block = b;
+          break;
+        }
+    }
   }
 
   if ( block != NULL ) {
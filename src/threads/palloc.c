@@ -9,6 +9,7 @@
 #include <string.h>
 #include "threads/loader.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -23,12 +24,19 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool also remembers which of its free pages are already
+   filled with zeros.  The idle thread zeros free pages in the
+   background through palloc_zero_idle(), so that most PAL_ZERO
+   requests can be satisfied without touching memory. */
 
    /* A memory pool. */
 struct pool {
   struct lock lock;                   /* Mutual exclusion. */
   struct bitmap *used_map;            /* Bitmap of free pages. */
+  struct bitmap *zero_map;            /* Free pages known to be zeroed. */
+  size_t zero_cursor;                 /* Where palloc_zero_idle() resumes. */
   uint8_t *base;                      /* Base of pool. */
 };
 
@@ -71,11 +79,28 @@ palloc_get_multiple( enum palloc_flags flags, size_t page_cnt ) {
   void *pages;
   size_t page_idx;
 
+  bool zeroed = false;
+
   if ( page_cnt == 0 )
     return NULL;
 
   lock_acquire( &pool->lock );
-  page_idx = bitmap_scan_and_flip( pool->used_map, 0, page_cnt, false );
+
+  /* Prefer a run of pages that the idle thread has already
+     zeroed, so that we don't have to clear them ourselves. */
+  page_idx = BITMAP_ERROR;
+  if ( flags & PAL_ZERO ) {
+    page_idx = bitmap_scan( pool->zero_map, 0, page_cnt, true );
+    if ( page_idx != BITMAP_ERROR ) {
+      bitmap_set_multiple( pool->used_map, page_idx, page_cnt, true );
+      zeroed = true;
+    }
+  }
+  if ( page_idx == BITMAP_ERROR )
+    page_idx = bitmap_scan_and_flip( pool->used_map, 0, page_cnt, false );
+  if ( page_idx != BITMAP_ERROR )
+    bitmap_set_multiple( pool->zero_map, page_idx, page_cnt, false );
+
   lock_release( &pool->lock );
 
   if ( page_idx != BITMAP_ERROR )
@@ -84,7 +109,7 @@ palloc_get_multiple( enum palloc_flags flags, size_t page_cnt ) {
     pages = NULL;
 
   if ( pages != NULL ) {
-    if ( flags & PAL_ZERO )
+    if ( ( flags & PAL_ZERO ) && !zeroed )
       memset( pages, 0, PGSIZE * page_cnt );
   }
   else {
@@ -140,14 +165,72 @@ palloc_free_page( void *page ) {
   palloc_free_multiple( page, 1 );
 }
 
+/* Zeros one free page that is not yet known to be zero, so that
+   a later PAL_ZERO allocation can skip the memset().  Called by
+   the idle thread whenever it has nothing better to do.
+   Returns true if a page was zeroed, false if every free page is
+   already zeroed or a pool was busy. */
+bool
+palloc_zero_idle( void ) {
+  struct pool *pools[] = { &user_pool, &kernel_pool };
+  size_t i;
+
+  for ( i = 0; i < sizeof pools / sizeof *pools; i++ ) {
+    struct pool *pool = pools[i];
+    size_t page_cnt = bitmap_size( pool->used_map );
+    size_t page_idx, scanned;
+
+    /* Never wait for the lock: the idle thread must not block. */
+    if ( !lock_try_acquire( &pool->lock ) )
+      continue;
+
+    /* Find a free page that has not been zeroed yet, starting
+       where we left off last time. */
+    page_idx = pool->zero_cursor;
+    for ( scanned = 0; scanned < page_cnt; scanned++, page_idx++ ) {
+      if ( page_idx >= page_cnt )
+        page_idx = 0;
+      if ( !bitmap_test( pool->used_map, page_idx )
+        && !bitmap_test( pool->zero_map, page_idx ) )
+        break;
+    }
+
+    if ( scanned < page_cnt ) {
+      /* Claim the page by marking it used, so that it cannot be
+         allocated out from under us, and zero it with the lock
+         released.  The idle thread may be preempted in the middle
+         of the memset and not run again for a long time, and
+         allocators must not wait for it all that while. */
+      bitmap_mark( pool->used_map, page_idx );
+      pool->zero_cursor = page_idx + 1;
+      lock_release( &pool->lock );
+
+      memset( pool->base + PGSIZE * page_idx, 0, PGSIZE );
+
+      /* Give the page back, now known to be zeroed.  The idle
+         thread must not block, so yield until the lock is free
+         instead of waiting on it. */
+      while ( !lock_try_acquire( &pool->lock ) )
+        thread_yield();
+      bitmap_reset( pool->used_map, page_idx );
+      bitmap_mark( pool->zero_map, page_idx );
+      lock_release( &pool->lock );
+      return true;
+    }
+    lock_release( &pool->lock );
+  }
+  return false;
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
 init_pool( struct pool *p, void *base, size_t page_cnt, const char *name ) {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
+  /* We'll put the pool's used_map and zero_map at its base.
+     Calculate the space needed for the bitmaps
      and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP( bitmap_buf_size( page_cnt ), PGSIZE );
+  size_t bm_size = bitmap_buf_size( page_cnt );
+  size_t bm_pages = DIV_ROUND_UP( 2 * bm_size, PGSIZE );
   if ( bm_pages > page_cnt )
     PANIC( "Not enough memory in %s for bitmap.", name );
   page_cnt -= bm_pages;
@@ -156,7 +239,10 @@ init_pool( struct pool *p, void *base, size_t page_cnt, const char *name ) {
 
   /* Initialize the pool. */
   lock_init( &p->lock );
-  p->used_map = bitmap_create_in_buf( page_cnt, base, bm_pages * PGSIZE );
+  p->used_map = bitmap_create_in_buf( page_cnt, base, bm_size );
+  p->zero_map = bitmap_create_in_buf( page_cnt, (uint8_t *)base + bm_size,
+    bm_size );
+  p->zero_cursor = 0;
   p->base = base + bm_pages * PGSIZE;
 }
 
@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/flags.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
 #include "threads/palloc.h"
@@ -292,6 +293,7 @@ thread_exit( void ) {
 #ifdef USERPROG
   process_exit();
 #endif
+  fpu_release( thread_current() );
 
   struct thread *curr = thread_current();
 
@@ -385,7 +387,10 @@ thread_get_recent_cpu( void ) {
    to it to enable thread_start() to continue, and immediately
    blocks.  After that, the idle thread never appears in the
    ready list.  It is returned by next_thread_to_run() as a
-   special case when the ready list is empty. */
+   special case when the ready list is empty.
+
+   Before blocking, the idle thread zeros free pages in the
+   background for the page allocator (see palloc_zero_idle()). */
 static void
 idle( void *idle_started_ UNUSED ) {
   struct semaphore *idle_started = idle_started_;
@@ -393,6 +398,12 @@ idle( void *idle_started_ UNUSED ) {
   sema_up( idle_started );
 
   for ( ;;) {
+    /* Use the spare cycles to zero free pages ahead of time, so
+       that PAL_ZERO allocations don't have to.  Stop as soon as
+       some other thread becomes ready to run. */
+    while ( list_empty( &ready_list ) && palloc_zero_idle() )
+      continue;
+
     /* Let someone else run. */
     intr_disable();
     thread_block();
@@ -537,10 +548,17 @@ thread_schedule_tail( struct thread *prev ) {
   thread_ticks = 0;
 
 #ifdef USERPROG
-  /* Activate the new address space. */
+  /* Activate the new address space.  Kernel threads keep the
+     previous thread's address space, so this only reloads CR3
+     when switching to a process with a different page
+     directory. */
   process_activate();
 #endif
 
+  /* Trap the new thread's first FPU instruction unless its FPU
+     state is still loaded. */
+  fpu_switch( cur );
+
   /* If the thread we switched from is dying, destroy its struct
      thread.  This must happen late so that thread_exit() doesn't
      pull out the rug under itself.  (We don't free
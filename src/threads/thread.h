@@ -121,6 +121,10 @@ struct thread {
    */
    int exit_code;                      /* Exit code */
 #endif
+
+   /* Owned by threads/fpu.c. */
+   void *fpu;                          /* FPU state, or NULL if unused. */
+
    /* Owned by thread.c. */
    unsigned magic;                     /* Detects stack overflow. */
 };
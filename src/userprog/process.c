@@ -231,11 +231,23 @@ process_exit( void ) {
 
 /* Sets up the CPU for running user code in the current
    thread.
-   This function is called on every context switch. */
+   This function is called on every context switch.
+
+   A kernel thread (one without a page directory of its own)
+   never touches user memory, so it simply keeps running on
+   whatever page directory the previous thread left active, like
+   Linux's "borrowed mm".  That way switching from a process to
+   the idle thread or an I/O helper and back costs no TLB flush
+   at all.  The borrowed page directory is never freed out from
+   under us, because process_exit() switches to the base page
+   directory before destroying its own. */
 void
 process_activate( void ) {
   struct thread *t = thread_current();
 
+  if ( t->pagedir == NULL )
+    return;
+
   /* Activate thread's page tables. */
   pagedir_activate( t->pagedir );
 
@@ -1,6 +1,9 @@
 #include "userprog/syscall.h"
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
+#include <uio.h>
+#include <dirent.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "devices/shutdown.h"
@@ -8,10 +11,18 @@
 #include "threads/malloc.h"
 #include "devices/input.h"
 #include "filesys/file.h"
+#include "filesys/directory.h"
+#include "filesys/inode.h"
 #include "userprog/process.h"
+#include "devices/block.h"
+#include "threads/vaddr.h"
 
 
 static void syscall_handler( struct intr_frame * );
+static int transfer_vector( struct file *, const struct iovec *, int, bool );
+static void lock_file( struct file * );
+static void unlock_file( struct file * );
+static bool is_directory( struct file * );
 
 void
 syscall_init( void ) {
@@ -104,8 +115,20 @@ syscall_handler( struct intr_frame *f ) {
 
     case SYS_CREATE:
     {
-      printf( "SYS_CREATE not yet implemented\n" );
-      f->eax = -1;
+      /* retrieve the name of the file to create
+       * and its initial size from esp, then
+       * create it with the file system locked,
+       * the same way a file is removed.
+       * names under /tmp/ are created in memory
+       * by the tmpfs rather than on the disk
+      */
+      char *file_name = *(char **)( esp + 4 );
+      unsigned initial_size = *(unsigned *)( esp + 8 );
+
+      lock_acquire( &file_lock );
+      f->eax = filesys_create( file_name, initial_size );
+      lock_release( &file_lock );
+
       break;
     }
     case SYS_REMOVE:
@@ -223,9 +246,9 @@ syscall_handler( struct intr_frame *f ) {
        * and then return the size to
        * eax and release the lock
       */
-      lock_acquire( &file_lock );
+      lock_file( file );
       f->eax = file_length( file );
-      lock_release( &file_lock );
+      unlock_file( file );
       break;
 
     }
@@ -282,9 +305,9 @@ syscall_handler( struct intr_frame *f ) {
          * read less than the expected
          * size and release the lock
         */
-        lock_acquire( &file_lock );
+        lock_file( file );
         size = file_read( file, buf, size );
-        lock_release( &file_lock );
+        unlock_file( file );
       }
 
       /* return the size of bytes
@@ -336,6 +359,13 @@ syscall_handler( struct intr_frame *f ) {
         */
         if ( file == NULL ) { f->eax = -1; break; }
 
+        /* directories are changed only by
+         * creating and removing files, so
+         * an opened directory can't be
+         * written to directly
+        */
+        if ( is_directory( file ) ) { f->eax = -1; break; }
+
         /* lock the file system to make
          * sure the file we are writing
          * into is not altered by
@@ -347,9 +377,9 @@ syscall_handler( struct intr_frame *f ) {
          * written less than the expected
          * size and release the lock
         */
-        lock_acquire( &file_lock );
+        lock_file( file );
         size = file_write( file, buf, size );
-        lock_release( &file_lock );
+        unlock_file( file );
       }
 
       /* return the size of bytes
@@ -422,9 +452,404 @@ syscall_handler( struct intr_frame *f ) {
       break;
     }
 
+    case SYS_BLKSTATS:
+    {
+      /* retrieve the name of the block
+       * device to report on and the
+       * structure to copy its statistics
+       * into from esp
+      */
+      const char *name = *(char **)( esp + 4 );
+      struct blkstat *stats = *(struct blkstat **)( esp + 8 );
+
+      /* the name can be that of a device,
+       * like "hda2", or of a role that a
+       * device plays, like "filesys", so
+       * that programmes don't need to know
+       * how the disks were set up
+      */
+      struct block *block = block_get_by_name( name );
+      for ( int role = 0; block == NULL && role < BLOCK_ROLE_CNT; role++ )
+        if ( !strcmp( name, block_type_name( role ) ) )
+          block = block_get_role( role );
+
+      /* fail if there is no such device */
+      if ( block == NULL ) { f->eax = false; break; }
+
+      block_get_stats( block, stats );
+      f->eax = true;
+      break;
+    }
+
+    case SYS_FSYNC:
+    {
+      /* retrieve the file descriptor
+       * number of the opened file
+       * whose changes must be made
+       * durable
+      */
+      int fd = *(int *)( esp + 4 );
+
+      /* retrieve the file map from the
+       * file list of the current running
+       * process using its file descriptor
+      */
+      struct file_map *file_map = get_file_map( fd );
+
+      /* make sure the file map was found,
+       * otherwise return a status fail
+      */
+      if ( file_map == NULL ) { f->eax = false; break; }
+
+      /* lock the file system so no
+       * other write slips in between,
+       * then wait until the file's data
+       * and metadata are on the disk.
+       * tmpfs files have nothing to sync
+       * and don't take the lock at all
+      */
+      lock_file( file_map->file );
+      f->eax = file_sync( file_map->file );
+      unlock_file( file_map->file );
+      break;
+    }
+
+    case SYS_SYNC:
+    {
+      /* write everything that has not
+       * reached the disk yet, for every
+       * file, and wait until it has
+      */
+      lock_acquire( &file_lock );
+      filesys_sync();
+      lock_release( &file_lock );
+      break;
+    }
+
+    case SYS_PREAD:
+    case SYS_PWRITE:
+    {
+      /* retrieve the file descriptor,
+       * the buffer, the size of bytes
+       * to transfer and the position in
+       * the file to transfer them at
+       * from esp
+      */
+      int fd = *(int *)( esp + 4 );
+      char *buf = *(char **)( esp + 8 );
+      unsigned size = *(unsigned *)( esp + 12 );
+      unsigned offset = *(unsigned *)( esp + 16 );
+
+      /* retrieve the file map from the
+       * file list of the current running
+       * process using its file descriptor.
+       * the terminal has no positions, so
+       * only opened files are accepted
+      */
+      struct file_map *file_map = get_file_map( fd );
+      if ( file_map == NULL ) { f->eax = -1; break; }
+
+      /* file positions are signed, so an
+       * offset, or an end of the transfer,
+       * past INT32_MAX would turn negative
+       * in the file layer and reach memory
+       * outside of the file's data
+      */
+      if ( offset > INT32_MAX || size > INT32_MAX - offset ) {
+        f->eax = -1;
+        break;
+      }
+
+      /* directories can't be written to */
+      if ( *(int *)esp == SYS_PWRITE && is_directory( file_map->file ) ) {
+        f->eax = -1;
+        break;
+      }
+
+      /* read or write at the given offset
+       * under the file system lock. unlike
+       * read and write, this neither uses
+       * nor moves the file's position, so
+       * threads sharing a file don't have
+       * to agree on where it is
+      */
+      lock_file( file_map->file );
+      if ( *(int *)esp == SYS_PREAD )
+        f->eax = file_read_at( file_map->file, buf, size, offset );
+      else
+        f->eax = file_write_at( file_map->file, buf, size, offset );
+      unlock_file( file_map->file );
+      break;
+    }
+
+    case SYS_READV:
+    case SYS_WRITEV:
+    {
+      /* retrieve the file descriptor,
+       * the array of buffers and the
+       * number of buffers in it from esp
+      */
+      int fd = *(int *)( esp + 4 );
+      const struct iovec *iov = *(struct iovec **)( esp + 8 );
+      int iovcnt = *(int *)( esp + 12 );
+      bool write = *(int *)esp == SYS_WRITEV;
+
+      /* check the number of buffers
+       * once, up front, instead of
+       * once per buffer
+      */
+      if ( iovcnt < 0 || iovcnt > IOV_MAX ) { f->eax = -1; break; }
+
+      /* writing to the terminal prints
+       * each buffer in turn */
+      if ( fd == 1 && write ) {
+        int total = 0;
+        for ( int i = 0; i < iovcnt; i++ ) {
+          putbuf( iov[i].iov_base, iov[i].iov_len );
+          total += iov[i].iov_len;
+        }
+        f->eax = total;
+        break;
+      }
+
+      /* reading from the terminal fills
+       * each buffer in turn */
+      if ( fd == 0 && !write ) {
+        int total = 0;
+        for ( int i = 0; i < iovcnt; i++ ) {
+          char *buf = iov[i].iov_base;
+          for ( size_t j = 0; j < iov[i].iov_len; j++ ) buf[j] = input_getc();
+          total += iov[i].iov_len;
+        }
+        f->eax = total;
+        break;
+      }
+
+      /* otherwise it must be an opened
+       * file from the file system
+      */
+      struct file_map *file_map = get_file_map( fd );
+      if ( file_map == NULL ) { f->eax = -1; break; }
+
+      /* directories can't be written to */
+      if ( write && is_directory( file_map->file ) ) { f->eax = -1; break; }
+
+      /* hold the file system lock across
+       * all of the buffers, so they are
+       * transferred as one contiguous
+       * piece of the file
+      */
+      lock_file( file_map->file );
+      f->eax = transfer_vector( file_map->file, iov, iovcnt, write );
+      unlock_file( file_map->file );
+      break;
+    }
+
+    case SYS_COPY_FILE_RANGE:
+    {
+      /* retrieve the file descriptor to
+       * copy from, the one to copy to and
+       * the number of bytes to copy from esp
+      */
+      int fd_in = *(int *)( esp + 4 );
+      int fd_out = *(int *)( esp + 8 );
+      unsigned size = *(unsigned *)( esp + 12 );
+
+      /* both ends must be opened files
+       * from the file system, the terminal
+       * can't be copied to or from
+      */
+      struct file_map *in = get_file_map( fd_in );
+      struct file_map *out = get_file_map( fd_out );
+      if ( in == NULL || out == NULL ) { f->eax = -1; break; }
+
+      /* directories can't be copied into */
+      if ( is_directory( out->file ) ) { f->eax = -1; break; }
+
+      /* a size too big for a file offset
+       * just means "to the end of the file" */
+      if ( (off_t) size < 0 ) size = INT32_MAX;
+
+      /* copy inside the kernel, from each
+       * file's current position, so the data
+       * never crosses into user memory and
+       * a whole copy costs one syscall
+       * instead of a read and a write for
+       * every small chunk. the file system
+       * lock is needed only if either end
+       * is on the disk
+      */
+      bool on_disk = !file_in_memory( in->file )
+                     || !file_in_memory( out->file );
+      if ( on_disk ) lock_acquire( &file_lock );
+      f->eax = file_copy( out->file, in->file, size );
+      if ( on_disk ) lock_release( &file_lock );
+      break;
+    }
+
+    case SYS_GETDENTS:
+    {
+      /* retrieve the file descriptor of
+       * the directory, the buffer to fill
+       * with entries and its size in bytes
+       * from esp
+      */
+      int fd = *(int *)( esp + 4 );
+      struct dirent *entries = *(struct dirent **)( esp + 8 );
+      unsigned size = *(unsigned *)( esp + 12 );
+
+      /* only an opened directory can be
+       * listed, not a file or the terminal
+      */
+      struct file_map *file_map = get_file_map( fd );
+      if ( file_map == NULL ) { f->eax = -1; break; }
+
+      lock_acquire( &file_lock );
+      struct inode *inode = file_get_inode( file_map->file );
+      if ( inode == NULL || !inode_is_dir( inode ) ) {
+        lock_release( &file_lock );
+        f->eax = -1;
+        break;
+      }
+
+      /* read as many entries as fit in the
+       * buffer in one go, continuing from
+       * where the last call stopped, which
+       * is kept as the file's position. a
+       * whole listing then takes a few
+       * calls instead of one per name
+      */
+      struct dir *dir = dir_open( inode_reopen( inode ) );
+      if ( dir == NULL ) {
+        lock_release( &file_lock );
+        f->eax = -1;
+        break;
+      }
+      dir_seek( dir, file_tell( file_map->file ) );
+      f->eax = dir_readdir_multiple( dir, entries,
+                                     size / sizeof( struct dirent ) );
+      file_seek( file_map->file, dir_tell( dir ) );
+      dir_close( dir );
+      lock_release( &file_lock );
+      break;
+    }
+
     default:
       printf( "syscall will not be implemented" );
       f->eax = -1;
       break;
   }
 }
+
+
+/* transfer data between FILE, at its
+ * current position, and the IOVCNT
+ * buffers in IOV, writing to the
+ * file if WRITE is true and reading
+ * from it otherwise.
+ *
+ * small buffers are gathered into (or
+ * scattered from) one kernel page, so
+ * the file sees a few large transfers
+ * instead of many small ones, each of
+ * which could cost a read-modify-write
+ * of a whole disk sector.
+ *
+ * returns the number of bytes
+ * transferred, which is short if the
+ * end of the file was reached, or -1
+ * if memory ran out. the caller must
+ * hold file_lock
+*/
+static int
+transfer_vector( struct file *file, const struct iovec *iov, int iovcnt,
+                 bool write ) {
+  char *page = malloc( PGSIZE );
+  int total = 0;
+  int i = 0;
+  size_t ofs = 0; /* bytes of iov[i] already done */
+
+  if ( page == NULL ) return -1;
+
+  while ( i < iovcnt ) {
+    /* the next piece of the file covers
+     * as many buffers, or parts of them,
+     * as fit in the page. for a read,
+     * just remember where they start
+    */
+    int first = i;
+    size_t first_ofs = ofs;
+    size_t size = 0;
+    while ( i < iovcnt && size < PGSIZE ) {
+      size_t n = iov[i].iov_len - ofs;
+      if ( n > PGSIZE - size ) n = PGSIZE - size;
+      if ( write ) memcpy( page + size, (char *) iov[i].iov_base + ofs, n );
+      size += n;
+      ofs += n;
+      if ( ofs == iov[i].iov_len ) { i++; ofs = 0; }
+    }
+    if ( size == 0 ) break;
+
+    /* one file operation for the
+     * whole piece
+    */
+    off_t done = write ? file_write( file, page, size )
+                       : file_read( file, page, size );
+
+    /* for a read, hand out what was
+     * read to the buffers it belongs to
+    */
+    if ( !write ) {
+      off_t copied = 0;
+      int j = first;
+      size_t j_ofs = first_ofs;
+      while ( copied < done ) {
+        size_t n = iov[j].iov_len - j_ofs;
+        if ( n > (size_t) ( done - copied ) ) n = done - copied;
+        memcpy( (char *) iov[j].iov_base + j_ofs, page + copied, n );
+        copied += n;
+        j_ofs += n;
+        if ( j_ofs == iov[j].iov_len ) { j++; j_ofs = 0; }
+      }
+    }
+
+    total += done;
+    if ( done < (off_t) size ) break; /* end of file */
+  }
+
+  free( page );
+  return total;
+}
+
+
+/* lock the file system before using
+ * FILE, unless FILE is in the tmpfs.
+ * tmpfs files lock themselves and never
+ * touch the disk, so reads and writes
+ * to them don't have to wait for (or
+ * hold up) disk operations of other
+ * processes
+*/
+static void
+lock_file( struct file *file ) {
+  if ( !file_in_memory( file ) ) lock_acquire( &file_lock );
+}
+
+/* release the lock taken by lock_file
+ * for FILE
+*/
+static void
+unlock_file( struct file *file ) {
+  if ( !file_in_memory( file ) ) lock_release( &file_lock );
+}
+
+/* return true if FILE is an opened
+ * directory rather than an ordinary
+ * file. tmpfs files have no inode
+ * and are never directories
+*/
+static bool
+is_directory( struct file *file ) {
+  struct inode *inode = file_get_inode( file );
+  return inode != NULL && inode_is_dir( inode );
+}